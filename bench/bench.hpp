@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+// Shared bits of the standalone benchmarks: a timer, heap allocation
+// counting and a results table. Each bench/*.cpp builds on its own; the
+// command line is at the top of the file.
+
+// Counts every operator new in the process. Only one translation unit may
+// define BENCH_COUNT_ALLOCATIONS before including this header.
+inline std::atomic<size_t> benchAllocations{ 0 };
+
+#if defined(BENCH_COUNT_ALLOCATIONS)
+// Out of line, or GCC pairs the inlined free() with operator new and warns.
+__attribute__((noinline)) void* operator new(size_t size) {
+    benchAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+// Keeps the optimiser from discarding a result.
+template <typename T>
+inline void benchKeep(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+    double nsPerOp = 0;
+    double allocsPerOp = 0;
+};
+
+// Runs body(iteration) iterations times after a short warm-up, best of
+// rounds, and reports time and allocations per call.
+template <typename Body>
+BenchResult benchRun(const std::string& name, size_t iterations, Body body, int rounds = 5) {
+    for (size_t i = 0; i < std::max<size_t>(1, iterations / 10); ++i) body(i);
+    BenchResult result{ name, 1e300, 0 };
+    for (int round = 0; round < rounds; ++round) {
+        size_t allocsBefore = benchAllocations.load();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; ++i) body(i);
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        result.nsPerOp = std::min(result.nsPerOp, elapsed / iterations);
+        result.allocsPerOp = (double)(benchAllocations.load() - allocsBefore) / iterations;
+    }
+    return result;
+}
+
+// Speedup is relative to the first result.
+inline void benchPrint(const std::vector<BenchResult>& results, const char* unit = "call") {
+#if defined(BENCH_COUNT_ALLOCATIONS)
+    std::printf("%-36s %14s %14s %10s\n", "", ("ns/" + std::string(unit)).c_str(), ("allocs/" + std::string(unit)).c_str(), "speedup");
+    for (const BenchResult& r : results) {
+        std::printf("%-36s %14.1f %14.2f %9.2fx\n", r.name.c_str(), r.nsPerOp, r.allocsPerOp, results.front().nsPerOp / r.nsPerOp);
+    }
+#else
+    std::printf("%-36s %14s %10s\n", "", ("ns/" + std::string(unit)).c_str(), "speedup");
+    for (const BenchResult& r : results) {
+        std::printf("%-36s %14.1f %9.2fx\n", r.name.c_str(), r.nsPerOp, results.front().nsPerOp / r.nsPerOp);
+    }
+#endif
+}
@@ -0,0 +1,109 @@
+// Persian name validation: the std::regex check isValidFarsiName used to
+// build on every call, a scalar decode loop, and the SSE2 paths in
+// text_validation.hpp. Also times isValidUtf8/countCodepoints against their
+// scalar loops on chat-sized text.
+//
+//   g++ -std=c++17 -O2 -I main bench/name_validation_bench.cpp -o name_validation_bench
+
+#include "bench.hpp"
+
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "text_validation.hpp"
+
+// The check from before text_validation.hpp (note the byte-length bounds).
+static bool regexFarsiName(const std::string& name) {
+    if (name.length() < 3 || name.length() > 15) {
+        return false;
+    }
+    std::regex farsiRegex(u8"^[\u0600-\u06FF]+$");
+    return std::regex_match(name, farsiRegex);
+}
+
+// isPersianName / isValidUtf8 / countCodepoints with the SSE2 blocks left out.
+static bool scalarPersianName(std::string_view s, size_t minLetters, size_t maxLetters) {
+    const uint32_t zwnj = 0x200C;
+    if (s.size() < minLetters * 2 || s.size() > maxLetters * 2 + (maxLetters - 1) * 3) return false;
+    size_t letters = 0;
+    bool lastWasJoiner = false;
+    for (size_t i = 0; i < s.size();) {
+        uint32_t codepoint;
+        size_t length = decodeUtf8(s, i, codepoint);
+        if (length == 0) return false;
+        if (isPersianLetter(codepoint)) {
+            ++letters;
+            lastWasJoiner = false;
+        } else if (codepoint == zwnj && letters > 0 && !lastWasJoiner) {
+            lastWasJoiner = true;
+        } else {
+            return false;
+        }
+        i += length;
+    }
+    return !lastWasJoiner && letters >= minLetters && letters <= maxLetters;
+}
+
+static bool scalarValidUtf8(std::string_view s) {
+    for (size_t i = 0; i < s.size();) {
+        uint32_t codepoint;
+        size_t length = decodeUtf8(s, i, codepoint);
+        if (length == 0) return false;
+        i += length;
+    }
+    return true;
+}
+
+static size_t scalarCountCodepoints(std::string_view s) {
+    size_t count = 0;
+    for (char c : s) {
+        if (!isUtf8Continuation((unsigned char)c)) ++count;
+    }
+    return count;
+}
+
+int main() {
+    // What arrives while users pick a name: mostly valid names of every
+    // length, some with ZWNJ, plus Latin, digits and emoji.
+    const std::vector<std::string> names = {
+        "علی", "مریم", "محمدرضا", "فاطمه‌زهرا", "امیرحسین", "سیدمحمدحسین", "زهرا", "عبدالرحمن",
+        "پرستوپرستوپرستو", "شهرزاد‌خانم", "کوروش", "آرمان", "ali", "علی۱۲۳", "😀😀😀", "مهدی 2",
+        "حسین‌", "سارا", "نگین‌دخت", "محمدامین‌رضایی"
+    };
+    std::string chatLine;
+    for (int i = 0; i < 8; ++i) chatLine += "hello everyone, ready for the next round? ";
+    chatLine += "سلام به همه، کسی برای بازی بعدی هست؟";
+
+    for (const std::string& name : names) {
+        if (isPersianName(name, 3, 15) != scalarPersianName(name, 3, 15)) {
+            std::fprintf(stderr, "SSE2 and scalar disagree on %s\n", name.c_str());
+            return 1;
+        }
+    }
+    if (isValidUtf8(chatLine) != scalarValidUtf8(chatLine) || countCodepoints(chatLine) != scalarCountCodepoints(chatLine)) {
+        std::fprintf(stderr, "SSE2 and scalar disagree on the chat line\n");
+        return 1;
+    }
+
+    const size_t iterations = 200000;
+    size_t n = names.size();
+    std::printf("names: %zu mixed submissions\n\n", n);
+    benchPrint({
+        benchRun("std::regex (old)", iterations / 100, [&](size_t i) { benchKeep(regexFarsiName(names[i % n])); }),
+        benchRun("isPersianName scalar", iterations, [&](size_t i) { benchKeep(scalarPersianName(names[i % n], 3, 15)); }),
+        benchRun("isPersianName SSE2", iterations, [&](size_t i) { benchKeep(isPersianName(names[i % n], 3, 15)); }),
+    }, "name");
+
+    std::printf("\nchat line: %zu bytes\n\n", chatLine.size());
+    benchPrint({
+        benchRun("isValidUtf8 scalar", iterations, [&](size_t) { benchKeep(scalarValidUtf8(chatLine)); }),
+        benchRun("isValidUtf8 SSE2", iterations, [&](size_t) { benchKeep(isValidUtf8(chatLine)); }),
+    }, "line");
+    std::printf("\n");
+    benchPrint({
+        benchRun("countCodepoints scalar", iterations, [&](size_t) { benchKeep(scalarCountCodepoints(chatLine)); }),
+        benchRun("countCodepoints SSE2", iterations, [&](size_t) { benchKeep(countCodepoints(chatLine)); }),
+    }, "line");
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Queue handoff under contention: SpscRing and MpmcRing against a bounded
+// std::mutex + std::deque queue, for one producer/one consumer and for
+// several of each. Producers and consumers spin (with a yield) on full and
+// empty, so the numbers are the cost of the queue itself, not of sleeping.
+//
+//   g++ -std=c++17 -O2 -pthread -I main bench/ring_bench.cpp -o ring_bench
+//   ./ring_bench [max threads per side, default: cores / 2]
+
+#include "bench.hpp"
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "ring_buffer.hpp"
+
+// The baseline: what a plain locked queue costs per item.
+template <typename T>
+class LockedQueue {
+public:
+    explicit LockedQueue(size_t capacity) : limit(capacity) {}
+
+    bool tryPush(T& item) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.size() >= limit) return false;
+        items.push_back(std::move(item));
+        return true;
+    }
+
+    bool tryPop(T& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (items.empty()) return false;
+        out = std::move(items.front());
+        items.pop_front();
+        return true;
+    }
+
+    size_t pushBatch(T* batch, size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t n = std::min(count, limit - items.size());
+        for (size_t i = 0; i < n; ++i) items.push_back(std::move(batch[i]));
+        return n;
+    }
+
+    size_t popBatch(T* out, size_t max) {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t n = std::min(max, items.size());
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = std::move(items.front());
+            items.pop_front();
+        }
+        return n;
+    }
+
+private:
+    std::mutex mutex;
+    std::deque<T> items;
+    size_t limit;
+};
+
+// Moves perProducer items from each producer to the consumers and returns
+// nanoseconds per item; checks every item arrived exactly once.
+template <typename Queue>
+double transfer(Queue& queue, size_t producers, size_t consumers, size_t perProducer, size_t batch) {
+    std::atomic<bool> go{ false };
+    std::atomic<uint64_t> received{ 0 };
+    std::atomic<uint64_t> checksum{ 0 };
+    uint64_t total = producers * perProducer;
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p]() {
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            std::vector<uint64_t> items(batch);
+            uint64_t next = p * perProducer + 1;
+            uint64_t end = next + perProducer;
+            while (next < end) {
+                if (batch == 1) {
+                    uint64_t item = next;
+                    if (queue.tryPush(item)) {
+                        ++next;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                    continue;
+                }
+                size_t n = (size_t)std::min<uint64_t>(batch, end - next);
+                for (size_t i = 0; i < n; ++i) items[i] = next + i;
+                size_t pushed = queue.pushBatch(items.data(), n);
+                next += pushed;
+                if (pushed < n) std::this_thread::yield();
+            }
+        });
+    }
+    for (size_t c = 0; c < consumers; ++c) {
+        threads.emplace_back([&]() {
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            std::vector<uint64_t> items(batch);
+            uint64_t sum = 0;
+            uint64_t count = 0;
+            while (received.load(std::memory_order_relaxed) < total) {
+                size_t n = batch == 1 ? (queue.tryPop(items[0]) ? 1 : 0) : queue.popBatch(items.data(), batch);
+                if (n == 0) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < n; ++i) sum += items[i];
+                count += n;
+                received.fetch_add(n, std::memory_order_relaxed);
+            }
+            checksum.fetch_add(sum);
+            benchKeep(count);
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads) thread.join();
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (received.load() != total || checksum.load() != total * (total + 1) / 2) {
+        std::fprintf(stderr, "lost or duplicated items: %llu of %llu\n", (unsigned long long)received.load(), (unsigned long long)total);
+        std::exit(1);
+    }
+    return ns / total;
+}
+
+template <typename Queue>
+BenchResult best(const std::string& name, size_t producers, size_t consumers, size_t perProducer, size_t batch, int rounds = 3) {
+    BenchResult result{ name, 1e300, 0 };
+    for (int round = 0; round < rounds; ++round) {
+        Queue queue(1024);
+        result.nsPerOp = std::min(result.nsPerOp, transfer(queue, producers, consumers, perProducer, batch));
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    size_t maxSide = argc > 1 ? (size_t)std::strtoul(argv[1], nullptr, 10) : std::max<size_t>(1, cores / 2);
+    const size_t items = 2000000;
+    std::printf("%zu hardware threads, queues of 1024\n", cores);
+
+    std::printf("\n1 producer / 1 consumer\n");
+    benchPrint({
+        best<LockedQueue<uint64_t>>("mutex+deque", 1, 1, items, 1),
+        best<SpscRing<uint64_t>>("SpscRing", 1, 1, items, 1),
+        best<MpmcRing<uint64_t>>("MpmcRing", 1, 1, items, 1),
+        best<LockedQueue<uint64_t>>("mutex+deque, batches of 32", 1, 1, items, 32),
+        best<SpscRing<uint64_t>>("SpscRing, batches of 32", 1, 1, items, 32),
+        best<MpmcRing<uint64_t>>("MpmcRing, batches of 32", 1, 1, items, 32),
+    }, "item");
+
+    for (size_t side = 2; side <= maxSide; side *= 2) {
+        std::printf("\n%zu producers / %zu consumers\n", side, side);
+        benchPrint({
+            best<LockedQueue<uint64_t>>("mutex+deque", side, side, items / side, 1),
+            best<MpmcRing<uint64_t>>("MpmcRing", side, side, items / side, 1),
+            best<LockedQueue<uint64_t>>("mutex+deque, batches of 32", side, side, items / side, 32),
+            best<MpmcRing<uint64_t>>("MpmcRing, batches of 32", side, side, items / side, 32),
+        }, "item");
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+// getUpdates decoding: the json DOM walk the bot used to do against the
+// UpdateSaxHandler path it uses now, on a 100-update batch shaped like real
+// traffic (text with entities, photos, callback queries with the full
+// message they came from).
+//
+//   g++ -std=c++17 -O2 -I main -I main/include bench/update_decode_bench.cpp -o update_decode_bench
+
+#define BENCH_COUNT_ALLOCATIONS
+#include "bench.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "update_batch.hpp"
+#include "update_sax.hpp"
+
+using json = nlohmann::json;
+
+static json user(int64_t id) {
+    return { {"id", id}, {"is_bot", false}, {"first_name", "کاربر"}, {"last_name", "آزمایشی"}, {"username", "user" + std::to_string(id)}, {"language_code", "fa"} };
+}
+
+static json chat(int64_t id) {
+    return { {"id", id}, {"first_name", "کاربر"}, {"username", "user" + std::to_string(id)}, {"type", "private"} };
+}
+
+static std::string recordedBatch(size_t updates) {
+    json result = json::array();
+    for (size_t i = 0; i < updates; ++i) {
+        int64_t chatId = 100000000 + (int64_t)(i % 37) * 7919;
+        json update = { {"update_id", 500000000 + (int64_t)i} };
+        if (i % 10 < 6) {
+            update["message"] = {
+                {"message_id", 1000 + i}, {"from", user(chatId)}, {"chat", chat(chatId)}, {"date", 1700000000 + i},
+                {"text", i % 3 == 0 ? "/profile" : "سلام به همه، کسی برای بازی بعدی هست؟"},
+                {"entities", i % 3 == 0 ? json::array({ { {"offset", 0}, {"length", 8}, {"type", "bot_command"} } }) : json::array()}
+            };
+        } else if (i % 10 < 8) {
+            json sizes = json::array();
+            for (int s = 0; s < 4; ++s) {
+                sizes.push_back({ {"file_id", "AgACAgQAAxkBAAI" + std::string(40, 'x')}, {"file_unique_id", "AQAD" + std::to_string(s)}, {"file_size", 1000 * (s + 1)}, {"width", 90 << s}, {"height", 60 << s} });
+            }
+            update["message"] = { {"message_id", 1000 + i}, {"from", user(chatId)}, {"chat", chat(chatId)}, {"date", 1700000000 + i}, {"photo", sizes}, {"caption", "عکس"} };
+        } else {
+            json keyboard = { {"inline_keyboard", json::array({ json::array({ { {"text", "تغییر نام"}, {"callback_data", "changeName"} }, { {"text", "تنظیمات بیشتر"}, {"callback_data", "setting"} } }) })} };
+            update["callback_query"] = {
+                {"id", std::to_string(4000000000000000000ll + (int64_t)i)}, {"from", user(chatId)}, {"chat_instance", "-123456789"}, {"data", "changeName"},
+                {"message", { {"message_id", 900 + i}, {"from", user(8262579615)}, {"chat", chat(chatId)}, {"date", 1700000000 + i}, {"text", "پروفایل بازیکن👤\n\n💢 آیدی: " + std::to_string(chatId)}, {"reply_markup", keyboard} }}
+            };
+        }
+        result.push_back(update);
+    }
+    return json{ {"ok", true}, {"result", result} }.dump();
+}
+
+// The decode loop from before the SAX handler, Message/Callback included.
+struct DomMessage {
+    std::string chat_id;
+    std::string text;
+};
+
+struct DomCallback {
+    std::string chat_id;
+    std::string data;
+    std::string callback_id;
+    int message_id;
+};
+
+static size_t decodeDom(const std::string& response, std::vector<DomMessage>& messages, std::vector<DomCallback>& callbacks) {
+    messages.clear();
+    callbacks.clear();
+    long long last_update_id = 0;
+    json j = json::parse(response);
+    if (!j.contains("result")) return 0;
+    for (auto& update : j["result"]) {
+        last_update_id = update["update_id"].get<long long>();
+        if (update.contains("callback_query")) {
+            auto cb = update["callback_query"];
+            std::string data = cb["data"];
+            std::string callback_id = cb["id"];
+            std::string chat_id = std::to_string(cb["message"]["chat"]["id"].get<long long>());
+            int message_id = cb["message"]["message_id"].get<int>();
+            callbacks.push_back({ chat_id, data, callback_id, message_id });
+        }
+        if (update.contains("message") && update["message"].contains("text")) {
+            auto msg = update["message"];
+            std::string text = msg["text"];
+            std::string chat_id = std::to_string(msg["chat"]["id"].get<long long>());
+            messages.push_back({ chat_id, text });
+        }
+    }
+    benchKeep(last_update_id);
+    return messages.size() + callbacks.size();
+}
+
+// What Bot::ingestUpdate does with each update the handler finishes.
+struct SaxMessage {
+    int64_t chat_id;
+    std::string_view text;
+};
+
+struct SaxCallback {
+    int64_t chat_id;
+    std::string_view data;
+    std::string_view callback_id;
+    int64_t message_id;
+};
+
+struct BatchSink {
+    UpdateBatch& batch;
+    std::vector<SaxMessage>& messages;
+    std::vector<SaxCallback>& callbacks;
+
+    void operator()(const UpdateFields& update) {
+        if (update.has_callback && update.has_callback_chat) {
+            callbacks.push_back({ update.callback_chat_id, batch.store(update.callback_data), batch.store(update.callback_id), update.callback_message_id });
+        }
+        if (update.has_text && update.has_message_chat) {
+            messages.push_back({ update.message_chat_id, batch.store(update.text) });
+        }
+    }
+};
+
+int main() {
+    const size_t updates = 100;
+    const size_t iterations = 2000;
+    std::string response = recordedBatch(updates);
+    std::printf("batch: %zu updates, %zu bytes\n\n", updates, response.size());
+
+    std::vector<DomMessage> domMessages;
+    std::vector<DomCallback> domCallbacks;
+    BenchResult dom = benchRun("json::parse DOM", iterations, [&](size_t) {
+        benchKeep(decodeDom(response, domMessages, domCallbacks));
+    });
+
+    UpdateBatch batch;
+    std::vector<SaxMessage> saxMessages;
+    std::vector<SaxCallback> saxCallbacks;
+    BatchSink sink{ batch, saxMessages, saxCallbacks };
+    using Parser = UpdateSaxHandler<BatchSink>;
+    BenchResult sax = benchRun("UpdateSaxHandler + arena", iterations, [&](size_t) {
+        batch.clear();
+        saxMessages.clear();
+        saxCallbacks.clear();
+        Parser parser(Parser::Mode::Envelope, sink);
+        json::sax_parse(response, &parser);
+        benchKeep(parser.count);
+    });
+
+    if (domMessages.size() != saxMessages.size() || domCallbacks.size() != saxCallbacks.size()) {
+        std::fprintf(stderr, "decoders disagree: %zu/%zu messages, %zu/%zu callbacks\n", domMessages.size(), saxMessages.size(), domCallbacks.size(), saxCallbacks.size());
+        return 1;
+    }
+    for (size_t i = 0; i < saxMessages.size(); ++i) {
+        if (domMessages[i].text != saxMessages[i].text || domMessages[i].chat_id != std::to_string(saxMessages[i].chat_id)) {
+            std::fprintf(stderr, "message %zu differs\n", i);
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < saxCallbacks.size(); ++i) {
+        if (domCallbacks[i].data != saxCallbacks[i].data || domCallbacks[i].callback_id != saxCallbacks[i].callback_id || domCallbacks[i].message_id != saxCallbacks[i].message_id) {
+            std::fprintf(stderr, "callback %zu differs\n", i);
+            return 1;
+        }
+    }
+    benchPrint({ dom, sax }, "batch");
+    return 0;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "send_engine.hpp"
+
+// Outcome of a Bot API call as handlers see it. message_id is set when the
+// result is a Message (sendMessage, editMessageText); error_code,
+// description and retry_after come from the error envelope.
+struct ApiResult {
+    CURLcode curl_code = CURLE_OK;
+    long http_status = 0;
+    bool ok = false;
+    int64_t message_id = 0;
+    long error_code = 0;
+    long retry_after = 0;
+    std::string description;
+};
+
+using ApiCallback = std::function<void(const ApiResult&)>;
+
+// Pulls the few fields above out of a response without building a DOM.
+class ApiResultSax final : public nlohmann::json_sax<nlohmann::json> {
+public:
+    explicit ApiResultSax(ApiResult& target) : result(target) {}
+
+    bool null() override {
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool boolean(bool val) override {
+        if (frames.size() == 1 && currentKey == Key::Ok) {
+            result.ok = val;
+        }
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool number_integer(number_integer_t val) override {
+        onInteger((int64_t)val);
+        return true;
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+        onInteger((int64_t)val);
+        return true;
+    }
+
+    bool number_float(number_float_t, const string_t&) override {
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool string(string_t& val) override {
+        if (frames.size() == 1 && currentKey == Key::Description) {
+            result.description = val;
+        }
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool binary(binary_t&) override {
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        frames.push_back(currentKey);
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        if (val == "ok") currentKey = Key::Ok;
+        else if (val == "result") currentKey = Key::Result;
+        else if (val == "message_id") currentKey = Key::MessageId;
+        else if (val == "error_code") currentKey = Key::ErrorCode;
+        else if (val == "description") currentKey = Key::Description;
+        else if (val == "parameters") currentKey = Key::Parameters;
+        else if (val == "retry_after") currentKey = Key::RetryAfter;
+        else currentKey = Key::Other;
+        return true;
+    }
+
+    bool end_object() override {
+        frames.pop_back();
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        frames.push_back(currentKey);
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool end_array() override {
+        frames.pop_back();
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override {
+        return false;
+    }
+
+private:
+    enum class Key : uint8_t {
+        Other,
+        Ok,
+        Result,
+        MessageId,
+        ErrorCode,
+        Description,
+        Parameters,
+        RetryAfter
+    };
+
+    ApiResult& result;
+    std::vector<Key> frames;
+    Key currentKey = Key::Other;
+
+    void onInteger(int64_t val) {
+        if (frames.size() == 1 && currentKey == Key::ErrorCode) {
+            result.error_code = (long)val;
+        } else if (frames.size() == 2 && frames[1] == Key::Result && currentKey == Key::MessageId) {
+            result.message_id = val;
+        } else if (frames.size() == 2 && frames[1] == Key::Parameters && currentKey == Key::RetryAfter) {
+            result.retry_after = (long)val;
+        }
+        currentKey = Key::Other;
+    }
+};
+
+inline ApiResult parseApiResult(const SendResult& sent) {
+    ApiResult result;
+    result.curl_code = sent.curl_code;
+    result.http_status = sent.http_status;
+    if (sent.curl_code != CURLE_OK) {
+        result.description = curl_easy_strerror(sent.curl_code);
+        return result;
+    }
+    ApiResultSax handler(result);
+    if (!nlohmann::json::sax_parse(sent.body, &handler)) {
+        result.ok = false;
+        if (result.description.empty()) {
+            result.description = "unparsable response (HTTP " + std::to_string(sent.http_status) + ")";
+        }
+    }
+    return result;
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "ring_buffer.hpp"
+
+// Runs jobs keyed by chat id on a fixed set of worker threads. Jobs for one
+// chat run one at a time in the order they were submitted; different chats
+// run in parallel. Chats hash onto virtual buckets, each owned by a single
+// worker, and rebalance() moves buckets from overloaded workers to idle
+// ones. A bucket only moves while it has nothing queued or running, so
+// state kept per bucket is never touched by two workers at once.
+class ChatExecutor {
+public:
+    using Job = std::function<void()>;
+
+    static constexpr size_t BUCKETS = 256;
+
+    struct Stats {
+        std::vector<uint64_t> executed;
+        std::vector<size_t> depth;
+        uint64_t migrations;
+    };
+
+    // A worker is hot when its recent load exceeds hotFactor x the mean.
+    double hotFactor = 1.5;
+    // Loads below this are never worth moving buckets for.
+    uint64_t minHotLoad = 64;
+    size_t maxMigrations = 8;
+    std::chrono::milliseconds rebalanceInterval{ 100 };
+
+    explicit ChatExecutor(size_t workerCount, size_t queueCapacity = 1024) {
+        workerCount = std::max<size_t>(1, workerCount);
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers.push_back(std::make_unique<Worker>(queueCapacity));
+        }
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            buckets[b].state.store((uint64_t)(b % workerCount) << OWNER_SHIFT, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < workerCount; ++i) {
+            Worker* worker = workers[i].get();
+            worker->thread = std::thread([this, worker]() {
+                run(*worker);
+            });
+        }
+    }
+
+    ~ChatExecutor() {
+        stop();
+    }
+
+    ChatExecutor(const ChatExecutor&) = delete;
+    ChatExecutor& operator=(const ChatExecutor&) = delete;
+
+    // Independent of FlatTable's hash, so a bucket's own tables still spread.
+    static size_t bucketOf(int64_t chatId) {
+        uint64_t x = (uint64_t)chatId;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return (size_t)((x ^ (x >> 31)) & (BUCKETS - 1));
+    }
+
+    size_t workerOf(int64_t chatId) const {
+        return (size_t)(buckets[bucketOf(chatId)].state.load(std::memory_order_acquire) >> OWNER_SHIFT);
+    }
+
+    // Blocks while the owning worker's queue is full, and while jobs that
+    // post() spilled are still waiting: they go first.
+    void submit(int64_t chatId, Job job) {
+        size_t bucket = bucketOf(chatId);
+        Worker& worker = claim(bucket);
+        Entry entry{ (uint32_t)bucket, std::move(job) };
+        if (worker.overflowCount > 0 || !worker.queue.tryPush(entry)) {
+            worker.space.wait([&]() {
+                return worker.overflowCount == 0 && worker.queue.tryPush(entry);
+            });
+        }
+        worker.ready.notify();
+    }
+
+    // Never blocks: when the queue is full the job waits in an overflow
+    // list. For threads that must not stall on the workers (the sender).
+    void post(int64_t chatId, Job job) {
+        size_t bucket = bucketOf(chatId);
+        Worker& worker = claim(bucket);
+        Entry entry{ (uint32_t)bucket, std::move(job) };
+        if (worker.overflowCount > 0 || !worker.queue.tryPush(entry)) {
+            std::lock_guard<std::mutex> lock(worker.overflowMutex);
+            worker.overflow.push_back(std::move(entry));
+            worker.overflowCount = worker.overflow.size();
+        }
+        worker.ready.notify();
+    }
+
+    // Moves idle buckets from the busiest worker to the least busy one when
+    // the busiest is hot. Cheap to call often: it runs at most once per
+    // rebalanceInterval. Returns the number of buckets moved.
+    size_t rebalance() {
+        std::unique_lock<std::mutex> lock(rebalanceMutex, std::try_to_lock);
+        if (!lock.owns_lock()) return 0;
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastRebalance < rebalanceInterval) return 0;
+        lastRebalance = now;
+
+        std::vector<uint64_t> load(workers.size(), 0);
+        uint64_t bucketLoad[BUCKETS];
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            bucketLoad[b] = buckets[b].recent.exchange(0, std::memory_order_relaxed) + buckets[b].carried;
+            load[owner(b)] += bucketLoad[b];
+        }
+        size_t hot = std::max_element(load.begin(), load.end()) - load.begin();
+        size_t cold = std::min_element(load.begin(), load.end()) - load.begin();
+        uint64_t total = 0;
+        for (uint64_t l : load) total += l;
+        double mean = (double)total / load.size();
+
+        size_t moved = 0;
+        if (hot != cold && load[hot] >= minHotLoad && load[hot] > hotFactor * mean) {
+            std::vector<size_t> candidates;
+            for (size_t b = 0; b < BUCKETS; ++b) {
+                if (owner(b) == hot && bucketLoad[b] > 0) candidates.push_back(b);
+            }
+            std::sort(candidates.begin(), candidates.end(), [&](size_t a, size_t b) {
+                return bucketLoad[a] > bucketLoad[b];
+            });
+            // A single very busy chat cannot be split; move its neighbours
+            // instead, as long as each move narrows the gap.
+            for (size_t b : candidates) {
+                if (moved >= maxMigrations) break;
+                if (load[cold] + bucketLoad[b] >= load[hot]) continue;
+                if (!migrate(b, hot, cold)) continue;
+                load[hot] -= bucketLoad[b];
+                load[cold] += bucketLoad[b];
+                ++moved;
+            }
+        }
+        // Halve the history so old bursts fade out.
+        for (size_t b = 0; b < BUCKETS; ++b) {
+            buckets[b].carried = bucketLoad[b] / 2;
+        }
+        migrations += moved;
+        return moved;
+    }
+
+    // Runs whatever is already queued, then joins the workers.
+    void stop() {
+        stopping = true;
+        for (auto& worker : workers) {
+            worker->ready.notify();
+            worker->space.notify();
+        }
+        for (auto& worker : workers) {
+            if (worker->thread.joinable()) worker->thread.join();
+        }
+    }
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    Stats stats() const {
+        Stats out{ {}, {}, migrations.load() };
+        for (const auto& worker : workers) {
+            out.executed.push_back(worker->executed.load());
+            out.depth.push_back(worker->queue.size() + worker->overflowCount.load());
+        }
+        return out;
+    }
+
+private:
+    static constexpr unsigned OWNER_SHIFT = 48;
+
+    struct Entry {
+        uint32_t bucket = 0;
+        Job job;
+    };
+
+    struct Worker {
+        MpmcRing<Entry> queue;
+        Parker ready;
+        Parker space;
+        std::mutex overflowMutex;
+        std::vector<Entry> overflow;
+        std::atomic<size_t> overflowCount{ 0 };
+        std::atomic<uint64_t> executed{ 0 };
+        std::thread thread;
+
+        explicit Worker(size_t capacity) : queue(capacity) {}
+    };
+
+    // state packs the owning worker (high bits) with the number of jobs
+    // queued or running (low bits); a move is a CAS from (owner, 0).
+    struct alignas(CACHE_LINE_SIZE) Bucket {
+        std::atomic<uint64_t> state{ 0 };
+        std::atomic<uint64_t> recent{ 0 };
+        uint64_t carried = 0;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    Bucket buckets[BUCKETS];
+    std::atomic<bool> stopping{ false };
+    std::atomic<uint64_t> migrations{ 0 };
+    std::mutex rebalanceMutex;
+    std::chrono::steady_clock::time_point lastRebalance;
+
+    size_t owner(size_t bucket) const {
+        return (size_t)(buckets[bucket].state.load(std::memory_order_acquire) >> OWNER_SHIFT);
+    }
+
+    // Counts the job against its bucket, which pins the bucket to its
+    // current owner until the job has run.
+    Worker& claim(size_t bucket) {
+        uint64_t state = buckets[bucket].state.fetch_add(1, std::memory_order_acq_rel);
+        buckets[bucket].recent.fetch_add(1, std::memory_order_relaxed);
+        return *workers[state >> OWNER_SHIFT];
+    }
+
+    bool migrate(size_t bucket, size_t from, size_t to) {
+        uint64_t idle = (uint64_t)from << OWNER_SHIFT;
+        return buckets[bucket].state.compare_exchange_strong(idle, (uint64_t)to << OWNER_SHIFT, std::memory_order_acq_rel);
+    }
+
+    void finish(Entry& entry) {
+        entry.job = nullptr;
+        buckets[entry.bucket].state.fetch_sub(1, std::memory_order_release);
+    }
+
+    void run(Worker& worker) {
+        Entry batch[32];
+        for (;;) {
+            worker.ready.wait([&]() {
+                return stopping || worker.queue.size() > 0 || worker.overflowCount > 0;
+            });
+            size_t n = worker.queue.popBatch(batch, 32);
+            if (n > 0) {
+                worker.space.notify();
+                for (size_t i = 0; i < n; ++i) {
+                    batch[i].job();
+                    finish(batch[i]);
+                }
+                worker.executed += n;
+                continue;
+            }
+            // Overflow is only taken once the ring is empty, so jobs that
+            // spilled still run after the ones queued before them. Nothing
+            // enters the ring while overflow is non-empty, so the ring does
+            // empty and no later job gets ahead of a spilled one.
+            if (worker.overflowCount > 0) {
+                std::vector<Entry> spilled;
+                {
+                    std::lock_guard<std::mutex> lock(worker.overflowMutex);
+                    spilled.swap(worker.overflow);
+                    worker.overflowCount = 0;
+                }
+                worker.space.notify();
+                for (Entry& entry : spilled) {
+                    entry.job();
+                    finish(entry);
+                }
+                worker.executed += spilled.size();
+                continue;
+            }
+            if (stopping) break;
+        }
+    }
+};
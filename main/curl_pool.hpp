@@ -0,0 +1,126 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+
+// Keeps easy handles alive between Bot API calls so their connection cache
+// (and the keep-alive TCP + TLS session to api.telegram.org) is reused.
+class CurlPool {
+public:
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t maxIdle = 16;
+    long dnsCacheSeconds = 300;
+    bool http2 = true;
+    CURLSH* share = NULL;
+
+    CurlPool() {
+        jsonHeaders = curl_slist_append(jsonHeaders, "Content-Type: application/json");
+    }
+
+    ~CurlPool() {
+        clear();
+        curl_slist_free_all(jsonHeaders);
+        curl_slist_free_all(resolveList);
+    }
+
+    CurlPool(const CurlPool&) = delete;
+    CurlPool& operator=(const CurlPool&) = delete;
+
+    CURL* acquire() {
+        if (!idle.empty()) {
+            CURL* curl = idle.back();
+            idle.pop_back();
+            ++hits;
+            return curl;
+        }
+        ++misses;
+        return create();
+    }
+
+    void release(CURL* curl) {
+        if (!curl) return;
+        if (idle.size() >= maxIdle) {
+            curl_easy_cleanup(curl);
+            return;
+        }
+        curl_easy_reset(curl);
+        applyDefaults(curl);
+        idle.push_back(curl);
+    }
+
+    struct curl_slist* headers() const {
+        return jsonHeaders;
+    }
+
+    // Pins a "host:port:address" mapping (CURLOPT_RESOLVE) on every handle,
+    // so that host is never looked up. Applies to handles handed out later.
+    void pinResolve(const std::string& entry) {
+        resolveList = curl_slist_append(resolveList, entry.c_str());
+    }
+
+    size_t idleCount() const {
+        return idle.size();
+    }
+
+    void warmUp(const std::string& url, size_t count) {
+        std::vector<CURL*> warmed;
+        for (size_t i = 0; i < count && idle.size() + warmed.size() < maxIdle; ++i) {
+            CURL* curl = create();
+            if (!curl) break;
+            std::string discard;
+            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discardCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &discard);
+            CURLcode res = curl_easy_perform(curl);
+            if (res != CURLE_OK) {
+                std::cerr << "warmUp Curl error: " << curl_easy_strerror(res) << std::endl;
+            }
+            warmed.push_back(curl);
+        }
+        for (CURL* curl : warmed) {
+            release(curl);
+        }
+    }
+
+    void clear() {
+        for (CURL* curl : idle) {
+            curl_easy_cleanup(curl);
+        }
+        idle.clear();
+    }
+
+private:
+    std::vector<CURL*> idle;
+    struct curl_slist* jsonHeaders = NULL;
+    struct curl_slist* resolveList = NULL;
+
+    static size_t discardCallback(void*, size_t size, size_t nmemb, void*) {
+        return size * nmemb;
+    }
+
+    CURL* create() {
+        CURL* curl = curl_easy_init();
+        if (curl) applyDefaults(curl);
+        return curl;
+    }
+
+    void applyDefaults(CURL* curl) {
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        if (share) {
+            curl_easy_setopt(curl, CURLOPT_SHARE, share);
+        }
+        curl_easy_setopt(curl, CURLOPT_DNS_CACHE_TIMEOUT, dnsCacheSeconds);
+        if (resolveList) {
+            curl_easy_setopt(curl, CURLOPT_RESOLVE, resolveList);
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, http2 ? (long)CURL_HTTP_VERSION_2TLS : (long)CURL_HTTP_VERSION_1_1);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, http2 ? 1L : 0L);
+        curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPIDLE, 30L);
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPINTVL, 15L);
+    }
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <mutex>
+#include <curl/curl.h>
+
+// DNS cache, TLS session cache and connection cache shared by every easy
+// handle, so a reconnect skips the lookup and resumes the TLS session
+// instead of doing a full handshake. The lock callbacks make it safe to
+// use from several threads.
+class CurlShare {
+public:
+    CurlShare() {
+        share = curl_share_init();
+        if (!share) return;
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockCallback);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockCallback);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    }
+
+    ~CurlShare() {
+        close();
+    }
+
+    CurlShare(const CurlShare&) = delete;
+    CurlShare& operator=(const CurlShare&) = delete;
+
+    CURLSH* handle() const {
+        return share;
+    }
+
+    // Every handle using the share must be cleaned up first.
+    void close() {
+        if (share && curl_share_cleanup(share) == CURLSHE_OK) {
+            share = NULL;
+        }
+    }
+
+private:
+    CURLSH* share = NULL;
+    std::mutex locks[CURL_LOCK_DATA_LAST];
+
+    static void lockCallback(CURL*, curl_lock_data data, curl_lock_access, void* userptr) {
+        static_cast<CurlShare*>(userptr)->locks[data].lock();
+    }
+
+    static void unlockCallback(CURL*, curl_lock_data data, void* userptr) {
+        static_cast<CurlShare*>(userptr)->locks[data].unlock();
+    }
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Open-addressing hash table keyed by 64-bit ids. Records live contiguously
+// in `entries` (cheap to iterate for broadcasts); the probe array holds only
+// the key and an index, so a lookup usually touches one slot cache line and
+// then the record itself. Erase swaps the last record into the hole, so
+// pointers/references are invalidated by emplace() and erase().
+template <typename Record>
+class FlatTable {
+public:
+    struct Entry {
+        int64_t key;
+        Record value;
+    };
+
+    FlatTable() {
+        rehash(16);
+    }
+
+    Record* find(int64_t key) {
+        size_t slot = locate(key);
+        return slots[slot].index == EMPTY ? nullptr : &entries[slots[slot].index].value;
+    }
+
+    const Record* find(int64_t key) const {
+        size_t slot = locate(key);
+        return slots[slot].index == EMPTY ? nullptr : &entries[slots[slot].index].value;
+    }
+
+    bool contains(int64_t key) const {
+        return find(key) != nullptr;
+    }
+
+    Record& emplace(int64_t key, Record value) {
+        size_t slot = locate(key);
+        if (slots[slot].index != EMPTY) {
+            return entries[slots[slot].index].value;
+        }
+        if ((entries.size() + 1) * 10 > slots.size() * 7) {
+            rehash(slots.size() * 2);
+            slot = locate(key);
+        }
+        slots[slot] = { key, (uint32_t)entries.size() };
+        entries.push_back({ key, std::move(value) });
+        return entries.back().value;
+    }
+
+    Record& operator[](int64_t key) {
+        Record* found = find(key);
+        return found ? *found : emplace(key, Record());
+    }
+
+    bool erase(int64_t key) {
+        size_t slot = locate(key);
+        uint32_t index = slots[slot].index;
+        if (index == EMPTY) return false;
+
+        uint32_t last = (uint32_t)entries.size() - 1;
+        if (index != last) {
+            slots[locate(entries[last].key)].index = index;
+            entries[index] = std::move(entries[last]);
+        }
+        entries.pop_back();
+
+        // Backward-shift deletion keeps probe chains intact without tombstones.
+        size_t hole = slot;
+        size_t next = (hole + 1) & mask;
+        while (slots[next].index != EMPTY) {
+            size_t home = bucket(slots[next].key);
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+            next = (next + 1) & mask;
+        }
+        slots[hole].index = EMPTY;
+        return true;
+    }
+
+    void reserve(size_t count) {
+        size_t capacity = slots.size();
+        while (count * 10 > capacity * 7) capacity *= 2;
+        if (capacity != slots.size()) rehash(capacity);
+        entries.reserve(count);
+    }
+
+    size_t size() const {
+        return entries.size();
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    typename std::vector<Entry>::iterator begin() { return entries.begin(); }
+    typename std::vector<Entry>::iterator end() { return entries.end(); }
+    typename std::vector<Entry>::const_iterator begin() const { return entries.begin(); }
+    typename std::vector<Entry>::const_iterator end() const { return entries.end(); }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot {
+        int64_t key;
+        uint32_t index;
+    };
+
+    std::vector<Slot> slots;
+    std::vector<Entry> entries;
+    size_t mask = 0;
+    unsigned shift = 0;
+
+    size_t bucket(int64_t key) const {
+        return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    size_t locate(int64_t key) const {
+        size_t slot = bucket(key);
+        while (slots[slot].index != EMPTY && slots[slot].key != key) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    void rehash(size_t capacity) {
+        slots.assign(capacity, Slot{ 0, EMPTY });
+        mask = capacity - 1;
+        shift = 64;
+        for (size_t c = capacity; c > 1; c >>= 1) --shift;
+        for (uint32_t i = 0; i < entries.size(); ++i) {
+            slots[locate(entries[i].key)] = { entries[i].key, i };
+        }
+    }
+};
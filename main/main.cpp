@@ -1,40 +1,120 @@
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <vector>
-#include <map>
 #include <curl/curl.h>
 #include <unistd.h>
 #include <nlohmann/json.hpp>
-#include <regex>
+#include <chrono>
+#include <charconv>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include "curl_share.hpp"
+#include "curl_pool.hpp"
+#include "send_engine.hpp"
+#include "webhook_server.hpp"
+#include "update_sax.hpp"
+#include "update_batch.hpp"
+#include "flat_table.hpp"
+#include "text_validation.hpp"
+#include "rooms.hpp"
+#include "rate_limiter.hpp"
+#include "timer_queue.hpp"
+#include "reactor.hpp"
+#include "retry_policy.hpp"
+#include "api_result.hpp"
+#include "task.hpp"
+#include "pipeline.hpp"
+#include "chat_executor.hpp"
+#include "shard_set.hpp"
 
 using json = nlohmann::json;
 
 class Bot {
 public:
+    // Views into `batch`; valid until finishBatch().
     struct Message {
-        std::string chat_id;
-        std::string text;
+        int64_t chat_id;
+        std::string_view text;
+        uint64_t webhook_ticket = 0;
+        int64_t update_id = 0;
     };
 
     struct Callback {
-        std::string chat_id;
-        std::string data;
-        std::string callback_id;
-        int message_id;
+        int64_t chat_id;
+        std::string_view data;
+        std::string_view callback_id;
+        int64_t message_id;
+        uint64_t webhook_ticket = 0;
+        int64_t update_id = 0;
+    };
+
+    struct PollConfig {
+        long timeout = 25;
+        int limit = 100;
+        std::vector<std::string> allowed_updates = { "message", "callback_query" };
+        int errorBackoffMs = 1000;
     };
 
     std::string token;
     std::string baseUrl;
-    long long int last_update_id = 0;
+    int64_t last_update_id = 0;
     std::vector<Message> receivedMessages;
     std::vector<Callback> receivedCallbacks;
+    UpdateBatch batch;
+    PollConfig pollConfig;
+    bool lastBatchFull = false;
+    CurlShare share;
+    CurlPool pool;
+    SendEngine engine{pool};
+    RateLimiter limiter;
+    TimerQueue timers;
+    RetryPolicy retryPolicy;
+    WebhookServer* webhook = nullptr;
+    Reactor* reactor = nullptr;
+    // Handles one batch of updates: from the reactor in single-threaded
+    // mode, from the handler thread in pipeline mode.
+    std::function<void(const std::vector<Message>&, const std::vector<Callback>&)> onBatch;
+
+    // A fetched batch together with the storage its views point into, so it
+    // can be handed to another thread as a whole.
+    struct InboundBatch {
+        UpdateBatch storage;
+        std::vector<Message> messages;
+        std::vector<Callback> callbacks;
+    };
+
+    // Calls onMessage(i) / onCallback(i) for a batch in update order. The
+    // two kinds are stored apart, but a changeName press and the name typed
+    // after it must still be handled in the order they were sent.
+    template <typename OnMessage, typename OnCallback>
+    static void forEachInOrder(const std::vector<Message>& messages, const std::vector<Callback>& callbacks, OnMessage onMessage, OnCallback onCallback) {
+        size_t m = 0;
+        size_t c = 0;
+        while (m < messages.size() || c < callbacks.size()) {
+            if (c < callbacks.size() && (m == messages.size() || callbacks[c].update_id < messages[m].update_id)) {
+                onCallback(c++);
+            } else {
+                onMessage(m++);
+            }
+        }
+    }
 
     Bot(const std::string& botToken) : token(botToken) {
         baseUrl = "https://api.telegram.org/bot" + token;
         curl_global_init(CURL_GLOBAL_ALL);
+        pool.share = share.handle();
     }
     
     ~Bot() {
+        engine.shutdown();
+        pool.clear();
+        share.close();
         curl_global_cleanup();
     }
 
@@ -44,144 +124,500 @@ public:
         return totalSize;
     }
 
-    void sendMessage(const std::string& chat_id, const std::string& text) {
-        CURL* curl = curl_easy_init();
-        if (curl) {
-            std::string url = baseUrl + "/sendMessage";
-            json payload = {
-                {"chat_id", chat_id},
-                {"text", text}
-            };
-            std::string payloadStr = payload.dump();
-            struct curl_slist* headers = NULL;
-            headers = curl_slist_append(headers, "Content-Type: application/json");
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payloadStr.c_str());
-            CURLcode res = curl_easy_perform(curl);
-            if (res != CURLE_OK) {
-                std::cerr << "sendMessage Curl error: " << curl_easy_strerror(res) << std::endl;
+    void warmUp(size_t connections) {
+        pool.warmUp(baseUrl + "/getMe", connections);
+    }
+
+    // Waits up to timeoutMs for transfers (and extraFd), firing due retry
+    // timers and releasing rate-limited sends as their buckets refill.
+    void poll(int timeoutMs, int extraFd = -1) {
+        timers.runDue();
+        limiter.pump();
+        for (int deadline : { limiter.msUntilReady(), timers.msUntilNext() }) {
+            if (deadline >= 0 && deadline < timeoutMs) {
+                timeoutMs = deadline;
             }
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
         }
+        engine.poll(timeoutMs, extraFd);
+        timers.runDue();
+        limiter.pump();
+        engine.perform();
     }
 
-    void sendGlassBtnMessage(const std::string& chat_id, const std::string& text, const std::vector<std::pair<std::string, std::string>>& buttons) {
-        CURL* curl = curl_easy_init();
-        if (curl) {
-            std::string url = baseUrl + "/sendMessage";
-            json keyboard = { {"inline_keyboard", json::array()} };
-            json row = json::array();
-            for (const auto& btn : buttons) {
-                row.push_back({ {"text", btn.first}, {"callback_data", btn.second} });
+    void flush() {
+        while (limiter.pending() > 0 || !timers.empty() || engine.busy()) {
+            poll(100);
+        }
+    }
+
+    std::chrono::milliseconds expectedDelay(int64_t chat_id) const {
+        return limiter.expectedDelay(chat_id);
+    }
+
+    void sendMessage(int64_t chat_id, std::string_view text, ApiCallback done = nullptr) {
+        postJson(chat_id, chat_id, "sendMessage", messagePayload(chat_id, text), "sendMessage", std::move(done));
+    }
+
+    // Sends the same text to every chat in chatIds. The escaped text is
+    // serialised once and each recipient's body is spliced from it, so a
+    // room relay costs one JSON dump instead of one per member. done runs
+    // once per recipient, in origin's handler context.
+    void broadcastMessage(int64_t origin, const std::vector<int64_t>& chatIds, std::string_view text, ApiCallback done = nullptr) {
+        if (chatIds.empty()) return;
+        std::string url = baseUrl + "/sendMessage";
+        std::string suffix = ",\"text\":" + json(text).dump() + "}";
+        const char prefix[] = "{\"chat_id\":";
+        std::vector<std::shared_ptr<OutboundRequest>> requests;
+        requests.reserve(chatIds.size());
+        for (int64_t chatId : chatIds) {
+            char id[24];
+            auto res = std::to_chars(id, id + sizeof(id), chatId);
+            std::string body;
+            body.reserve(sizeof(prefix) - 1 + (size_t)(res.ptr - id) + suffix.size());
+            body.append(prefix, sizeof(prefix) - 1);
+            body.append(id, res.ptr);
+            body.append(suffix);
+            requests.push_back(std::make_shared<OutboundRequest>(OutboundRequest{ chatId, origin, url, std::move(body), "broadcastMessage", done }));
+        }
+        submitOnLoop(std::move(requests));
+    }
+
+    void sendGlassBtnMessage(int64_t chat_id, std::string_view text, const std::vector<std::pair<std::string, std::string>>& buttons, ApiCallback done = nullptr) {
+        postJson(chat_id, chat_id, "sendMessage", glassBtnPayload(chat_id, text, buttons), "sendGlassBtnMessage", std::move(done));
+    }
+
+    // chat_id is the chat the query came from; the answer itself only
+    // counts against the global limit.
+    void answerCallbackQuery(int64_t chat_id, std::string_view callback_id, std::string_view text, ApiCallback done = nullptr) {
+        postJson(0, chat_id, "answerCallbackQuery", callbackAnswerPayload(callback_id, text), "answerCallbackQuery", std::move(done));
+    }
+
+    // reply* variants return the call inside the webhook response of the
+    // update identified by ticket when it is still open, and fall back to a
+    // regular request otherwise (polling mode, or the slot is already used).
+    void replyMessage(uint64_t ticket, int64_t chat_id, std::string_view text) {
+        replyJson(ticket, chat_id, chat_id, "sendMessage", messagePayload(chat_id, text), "replyMessage");
+    }
+
+    void replyGlassBtnMessage(uint64_t ticket, int64_t chat_id, std::string_view text, const std::vector<std::pair<std::string, std::string>>& buttons) {
+        replyJson(ticket, chat_id, chat_id, "sendMessage", glassBtnPayload(chat_id, text, buttons), "replyGlassBtnMessage");
+    }
+
+    void replyCallbackQuery(uint64_t ticket, int64_t chat_id, std::string_view callback_id, std::string_view text) {
+        replyJson(ticket, 0, chat_id, "answerCallbackQuery", callbackAnswerPayload(callback_id, text), "replyCallbackQuery");
+    }
+
+    void editMessageText(int64_t chat_id, int64_t message_id, std::string_view new_text, ApiCallback done = nullptr) {
+        json payload = {
+            {"chat_id", chat_id},
+            {"message_id", message_id},
+            {"text", new_text}
+        };
+        postJson(chat_id, chat_id, "editMessageText", payload, "editMessageText", std::move(done));
+    }
+
+    void fetchUpdatesOnce() {
+        bool done = false;
+        bool failed = true;
+        long serverTimeout = lastBatchFull ? 0 : pollConfig.timeout;
+        batch.raw.clear();
+        engine.get(getUpdatesUrl(serverTimeout), "fetchUpdatesOnce", [&](const SendResult& result) {
+            done = true;
+            if (result.curl_code == CURLE_OK) {
+                failed = !parseUpdates(batch.raw);
             }
-            keyboard["inline_keyboard"].push_back(row);
-            json payload = {
-                {"chat_id", chat_id},
-                {"text", text},
-                {"reply_markup", keyboard}
-            };
-            std::string payloadStr = payload.dump();
-            struct curl_slist* headers = NULL;
-            headers = curl_slist_append(headers, "Content-Type: application/json");
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payloadStr.c_str());
-            CURLcode res = curl_easy_perform(curl);
-            if (res != CURLE_OK) {
-                std::cerr << "sendGlassBtnMessage Curl error: " << curl_easy_strerror(res) << std::endl;
+        }, (serverTimeout + 10) * 1000, &batch.raw);
+        while (!done) {
+            poll(1000);
+        }
+        if (failed) {
+            lastBatchFull = false;
+            waitFor(pollConfig.errorBackoffMs);
+        }
+    }
+
+    bool setWebhook(const std::string& url, const std::string& secretToken, int maxConnections) {
+        json payload = {
+            {"url", url},
+            {"max_connections", maxConnections},
+            {"allowed_updates", pollConfig.allowed_updates}
+        };
+        if (!secretToken.empty()) {
+            payload["secret_token"] = secretToken;
+        }
+        return callSync("setWebhook", payload);
+    }
+
+    bool deleteWebhook() {
+        return callSync("deleteWebhook", json::object());
+    }
+
+    void attachWebhook(WebhookServer& server) {
+        webhook = &server;
+        server.onUpdate = [this](const std::string& body, uint64_t ticket) {
+            parseWebhookUpdate(body, ticket);
+        };
+    }
+
+    void receiveWebhookUpdates(int timeoutMs) {
+        if (!webhook) return;
+        poll(timeoutMs, webhook->fd());
+        webhook->poll(0);
+    }
+
+    // co_await-able forms of the send methods. They go through the same
+    // rate limiting and retries and resume the coroutine with the result;
+    // the payload is serialised before the call returns, so views passed in
+    // need not outlive the suspension.
+    CallbackAwaitable<ApiResult> sendMessageAsync(int64_t chat_id, std::string_view text) {
+        return apiCall(chat_id, chat_id, "sendMessage", messagePayload(chat_id, text), "sendMessageAsync");
+    }
+
+    CallbackAwaitable<ApiResult> sendGlassBtnMessageAsync(int64_t chat_id, std::string_view text, const std::vector<std::pair<std::string, std::string>>& buttons) {
+        return apiCall(chat_id, chat_id, "sendMessage", glassBtnPayload(chat_id, text, buttons), "sendGlassBtnMessageAsync");
+    }
+
+    CallbackAwaitable<ApiResult> answerCallbackQueryAsync(int64_t chat_id, std::string_view callback_id, std::string_view text) {
+        return apiCall(0, chat_id, "answerCallbackQuery", callbackAnswerPayload(callback_id, text), "answerCallbackQueryAsync");
+    }
+
+    CallbackAwaitable<ApiResult> editMessageTextAsync(int64_t chat_id, int64_t message_id, std::string_view new_text) {
+        json payload = {
+            {"chat_id", chat_id},
+            {"message_id", message_id},
+            {"text", new_text}
+        };
+        return apiCall(chat_id, chat_id, "editMessageText", payload, "editMessageTextAsync");
+    }
+
+    // Resumes with true once a getUpdates batch has been ingested into
+    // receivedMessages/receivedCallbacks; finish it with finishBatch().
+    CallbackAwaitable<bool> fetchUpdatesAsync() {
+        return CallbackAwaitable<bool>([this](std::function<void(const bool&)> done) {
+            requestUpdates("fetchUpdatesAsync", std::move(done));
+        });
+    }
+
+    // Moves the bot onto reactor: sends, retries and rate-limit refills run
+    // from its events, and updates arrive through the webhook server if one
+    // is attached, otherwise through a chain of long polls. Each batch is
+    // handed to onBatch and finished automatically.
+    void attachReactor(Reactor& eventLoop, bool receiveUpdates = true) {
+        reactor = &eventLoop;
+        loopThread = std::this_thread::get_id();
+        engine.attach(eventLoop);
+        eventLoop.addHook([this]() {
+            timers.runDue();
+            limiter.pump();
+            engine.perform();
+            int next = timers.msUntilNext();
+            int ready = limiter.msUntilReady();
+            return next < 0 || (ready >= 0 && ready < next) ? ready : next;
+        });
+        if (!receiveUpdates) return;
+        if (webhook) {
+            eventLoop.watch(webhook->fd(), EPOLLIN, [this](uint32_t) {
+                webhook->poll(0);
+                dispatchBatch();
+            });
+        } else {
+            startLongPoll();
+        }
+    }
+
+    // Pipeline mode: this bot is the sender stage running on the reactor
+    // thread (attachReactor(loop, false) first). Sends made from handler
+    // threads are queued to the loop, and their results are delivered back
+    // on the handler thread.
+    void attachPipeline(Pipeline<InboundBatch>& stages) {
+        toLoop = [&stages](std::function<void()> call) {
+            stages.send(std::move(call));
+        };
+        toHandlers = [&stages](int64_t, std::function<void()> call) {
+            stages.complete(std::move(call));
+        };
+    }
+
+    // With several handler workers (after attachPipeline): a result is
+    // delivered on the worker that owns the chat that made the request, in
+    // order with that chat's updates.
+    void attachExecutor(ChatExecutor& workers) {
+        toHandlers = [&workers](int64_t origin, std::function<void()> call) {
+            workers.post(origin, std::move(call));
+        };
+    }
+
+    // Ingest stage: one blocking getUpdates round; the batch is swapped
+    // into out (whose old buffers this bot reuses). False when it was empty.
+    bool takeBatch(InboundBatch& out) {
+        fetchUpdatesOnce();
+        bool got = !receivedMessages.empty() || !receivedCallbacks.empty();
+        if (got) {
+            std::swap(out.storage, batch);
+            out.messages.swap(receivedMessages);
+            out.callbacks.swap(receivedCallbacks);
+        }
+        finishBatch();
+        return got;
+    }
+
+    // Pipelined webhook requests parsed by replyAll() land in the cleared
+    // batch, ready for the next round.
+    void finishBatch() {
+        receivedMessages.clear();
+        receivedCallbacks.clear();
+        batch.clear();
+        if (webhook) {
+            webhook->replyAll();
+        }
+        limiter.pump();
+        engine.perform();
+    }
+
+    void waitFor(int timeoutMs) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (auto now = std::chrono::steady_clock::now(); now < deadline; now = std::chrono::steady_clock::now()) {
+            poll((int)std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count() + 1);
+        }
+    }
+
+private:
+    static json messagePayload(int64_t chat_id, std::string_view text) {
+        return {
+            {"chat_id", chat_id},
+            {"text", text}
+        };
+    }
+
+    static json glassBtnPayload(int64_t chat_id, std::string_view text, const std::vector<std::pair<std::string, std::string>>& buttons) {
+        json keyboard = { {"inline_keyboard", json::array()} };
+        json row = json::array();
+        for (const auto& btn : buttons) {
+            row.push_back({ {"text", btn.first}, {"callback_data", btn.second} });
+        }
+        keyboard["inline_keyboard"].push_back(row);
+        return {
+            {"chat_id", chat_id},
+            {"text", text},
+            {"reply_markup", keyboard}
+        };
+    }
+
+    static json callbackAnswerPayload(std::string_view callback_id, std::string_view text) {
+        return {
+            {"callback_query_id", callback_id},
+            {"text", text},
+            {"show_alert", false}
+        };
+    }
+
+    // A send that may go out more than once: the body is kept until the
+    // call succeeds, fails for good or runs out of attempts. chat_id is the
+    // flood bucket (and engine lane) it goes through; origin is the chat
+    // whose handler made the call and gets done back.
+    struct OutboundRequest {
+        int64_t chat_id;
+        int64_t origin;
+        std::string url;
+        std::string body;
+        const char* caller;
+        ApiCallback done;
+        int attempt = 1;
+    };
+
+    std::minstd_rand rng{ std::random_device{}() };
+    std::function<void(std::function<void()>)> toLoop;
+    std::function<void(int64_t, std::function<void()>)> toHandlers;
+    std::thread::id loopThread;
+
+    // chat_id selects the per-chat flood bucket; 0 for calls that only
+    // count against the global limit.
+    void postJson(int64_t chat_id, int64_t origin, const std::string& method, const json& payload, const char* caller, ApiCallback done) {
+        submitOnLoop({ std::make_shared<OutboundRequest>(OutboundRequest{ chat_id, origin, baseUrl + "/" + method, payload.dump(), caller, std::move(done) }) });
+    }
+
+    // Requests are built (and serialised) on the calling thread; only the
+    // hand-off to the limiter and engine has to happen on the loop thread.
+    void submitOnLoop(std::vector<std::shared_ptr<OutboundRequest>> requests) {
+        if (toLoop && std::this_thread::get_id() != loopThread) {
+            toLoop([this, requests = std::move(requests)]() mutable {
+                submitOnLoop(std::move(requests));
+            });
+            return;
+        }
+        for (auto& request : requests) {
+            submitRequest(std::move(request));
+        }
+        engine.perform();
+    }
+
+    CallbackAwaitable<ApiResult> apiCall(int64_t chat_id, int64_t origin, const char* method, json payload, const char* caller) {
+        return CallbackAwaitable<ApiResult>([this, chat_id, origin, method, payload = std::move(payload), caller](ApiCallback done) {
+            postJson(chat_id, origin, method, payload, caller, std::move(done));
+        });
+    }
+
+    // The chat id is also the request's engine lane: a chat's messages go
+    // out one at a time, so they arrive in the order they were sent.
+    void submitRequest(std::shared_ptr<OutboundRequest> request) {
+        int64_t chatId = request->chat_id;
+        limiter.submit(chatId, [this, request = std::move(request)]() {
+            engine.post(request->url, request->body, request->caller, [this, request](const SendResult& result) {
+                onSendResult(request, result);
+            }, 0, request->chat_id);
+        });
+    }
+
+    // Retries go through the timer queue, never a sleep: a throttled chat
+    // waits out its retry_after while everyone else keeps sending.
+    void onSendResult(const std::shared_ptr<OutboundRequest>& request, const SendResult& result) {
+        if (result.ok() && !request->done) return;
+        ApiResult api = parseApiResult(result);
+        if (api.ok || !RetryPolicy::retryable(result) || request->attempt >= retryPolicy.maxAttempts) {
+            if (!api.ok && result.curl_code == CURLE_OK) {
+                std::cerr << request->caller << " failed: " << result.http_status << " " << api.description << std::endl;
+            }
+            if (request->done && toHandlers) {
+                toHandlers(request->origin, [done = request->done, api]() {
+                    done(api);
+                });
+            } else if (request->done) {
+                request->done(api);
             }
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
+            return;
+        }
+        std::chrono::milliseconds delay = retryPolicy.backoff(request->attempt, rng);
+        if (api.retry_after > 0) {
+            delay = std::chrono::seconds(api.retry_after);
+            limiter.holdOff(request->chat_id, delay);
         }
+        ++request->attempt;
+        timers.schedule(delay, [this, request]() {
+            submitRequest(request);
+        });
     }
 
-    void answerCallbackQuery(const std::string& callback_id, const std::string& text) {
-        CURL* curl = curl_easy_init();
-        if (curl) {
-            std::string url = baseUrl + "/answerCallbackQuery";
-            json payload = {
-                {"callback_query_id", callback_id},
-                {"text", text},
-                {"show_alert", false}
-            };
-            std::string payloadStr = payload.dump();
-            struct curl_slist* headers = NULL;
-            headers = curl_slist_append(headers, "Content-Type: application/json");
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payloadStr.c_str());
-            CURLcode res = curl_easy_perform(curl);
-            if (res != CURLE_OK) {
-                std::cerr << "answerCallbackQuery Curl error: " << curl_easy_strerror(res) << std::endl;
+    // An inline webhook reply still counts against the flood limits, so it
+    // is only used while the chat has a token to spare, and never while an
+    // earlier send to the chat is still on its way (it would overtake it).
+    void replyJson(uint64_t ticket, int64_t chat_id, int64_t origin, const std::string& method, json payload, const char* caller) {
+        if (ticket != 0 && webhook && webhook->pending(ticket) && !engine.sending(chat_id) && limiter.tryAcquire(chat_id)) {
+            payload["method"] = method;
+            webhook->reply(ticket, payload.dump());
+            return;
+        }
+        postJson(chat_id, origin, method, payload, caller, nullptr);
+    }
+
+    bool callSync(const std::string& method, const json& payload) {
+        bool done = false;
+        bool ok = false;
+        engine.post(baseUrl + "/" + method, payload.dump(), method.c_str(), [&](const SendResult& result) {
+            done = true;
+            if (!result.ok()) {
+                std::cerr << method << " failed: " << result.http_status << " " << result.body << std::endl;
+                return;
             }
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
+            ok = true;
+        });
+        while (!done) {
+            poll(1000);
         }
+        return ok;
     }
 
-    void editMessageText(const std::string& chat_id, int message_id, const std::string& new_text) {
-        CURL* curl = curl_easy_init();
-        if (curl) {
-            std::string url = baseUrl + "/editMessageText";
-            json payload = {
-                {"chat_id", chat_id},
-                {"message_id", message_id},
-                {"text", new_text}
-            };
-            std::string payloadStr = payload.dump();
-            struct curl_slist* headers = NULL;
-            headers = curl_slist_append(headers, "Content-Type: application/json");
-            curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payloadStr.c_str());
-            CURLcode res = curl_easy_perform(curl);
-            if (res != CURLE_OK) {
-                std::cerr << "editMessageText Curl error: " << curl_easy_strerror(res) << std::endl;
+    std::string getUpdatesUrl(long serverTimeout) const {
+        std::string url = baseUrl + "/getUpdates?offset=" + std::to_string(last_update_id + 1)
+            + "&limit=" + std::to_string(pollConfig.limit)
+            + "&timeout=" + std::to_string(serverTimeout);
+        if (!pollConfig.allowed_updates.empty()) {
+            std::string allowed = json(pollConfig.allowed_updates).dump();
+            char* escaped = curl_easy_escape(NULL, allowed.c_str(), (int)allowed.size());
+            if (escaped) {
+                url += "&allowed_updates=";
+                url += escaped;
+                curl_free(escaped);
             }
-            curl_easy_cleanup(curl);
-            curl_slist_free_all(headers);
         }
+        return url;
     }
 
-    void fetchUpdatesOnce() {
-        CURL* curl = curl_easy_init();
-        if (curl) {
-            std::string response;
-            std::string getUpdatesUrl = baseUrl + "/getUpdates?offset=" + std::to_string(last_update_id + 1);
-            curl_easy_setopt(curl, CURLOPT_URL, getUpdatesUrl.c_str());
-            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-            CURLcode res = curl_easy_perform(curl);
-            if (res == CURLE_OK) {
-                try {
-                    json j = json::parse(response);
-                    if (!j.contains("result")) return;
-                    for (auto& update : j["result"]) {
-                        last_update_id = update["update_id"].get<long long>();
-                        if (update.contains("callback_query")) {
-                            auto cb = update["callback_query"];
-                            std::string data = cb["data"];
-                            std::string callback_id = cb["id"];
-                            std::string chat_id = std::to_string(cb["message"]["chat"]["id"].get<long long>());
-                            int message_id = cb["message"]["message_id"].get<int>();
-                            receivedCallbacks.push_back({ chat_id, data, callback_id, message_id });
-                        }
-                        if (update.contains("message") && update["message"].contains("text")) {
-                            auto msg = update["message"];
-                            std::string text = msg["text"];
-                            std::string chat_id = std::to_string(msg["chat"]["id"].get<long long>());
-                            receivedMessages.push_back({ chat_id, text });
-                        }
-                    }
-                } catch (std::exception& e) {
-                    std::cerr << "JSON parsing error: " << e.what() << " Response: " << response << std::endl;
-                }
-            } else {
-                std::cerr << "fetchUpdatesOnce Curl error: " << curl_easy_strerror(res) << std::endl;
+    struct UpdateSink {
+        Bot& bot;
+        uint64_t ticket;
+
+        void operator()(const UpdateFields& fields) {
+            bot.ingestUpdate(fields, ticket);
+        }
+    };
+
+    using UpdateParser = UpdateSaxHandler<UpdateSink>;
+
+    bool parseUpdates(const std::string& response) {
+        UpdateSink sink{ *this, 0 };
+        UpdateParser parser(UpdateParser::Mode::Envelope, sink);
+        if (!json::sax_parse(response, &parser) || !parser.ok) {
+            std::cerr << "JSON parsing error: " << (parser.error.empty() ? parser.description : parser.error) << " Response: " << response << std::endl;
+            return false;
+        }
+        lastBatchFull = pollConfig.limit > 0 && parser.count >= (size_t)pollConfig.limit;
+        return true;
+    }
+
+    void parseWebhookUpdate(const std::string& body, uint64_t ticket) {
+        UpdateSink sink{ *this, ticket };
+        UpdateParser parser(UpdateParser::Mode::SingleUpdate, sink);
+        if (!json::sax_parse(body, &parser)) {
+            std::cerr << "JSON parsing error: " << parser.error << " Webhook body: " << body << std::endl;
+        }
+    }
+
+    // One getUpdates round trip; done(true) once the batch is ingested.
+    void requestUpdates(const char* caller, std::function<void(const bool&)> done) {
+        long serverTimeout = lastBatchFull ? 0 : pollConfig.timeout;
+        batch.raw.clear();
+        engine.get(getUpdatesUrl(serverTimeout), caller, [this, done = std::move(done)](const SendResult& result) {
+            bool ok = result.curl_code == CURLE_OK && parseUpdates(batch.raw);
+            if (!ok) {
+                lastBatchFull = false;
+            }
+            done(ok);
+        }, (serverTimeout + 10) * 1000, &batch.raw);
+        engine.perform();
+    }
+
+    void startLongPoll() {
+        requestUpdates("startLongPoll", [this](const bool& ok) {
+            if (ok) {
+                dispatchBatch();
+                startLongPoll();
+                return;
             }
-            curl_easy_cleanup(curl);
+            timers.schedule(std::chrono::milliseconds(pollConfig.errorBackoffMs), [this]() {
+                startLongPoll();
+            });
+        });
+    }
+
+    // finishBatch() may ingest webhook requests that were pipelined behind
+    // the ones just answered; they are dispatched here rather than waiting
+    // for an event on a connection that may never see another one.
+    void dispatchBatch() {
+        do {
+            if ((!receivedMessages.empty() || !receivedCallbacks.empty()) && onBatch) {
+                onBatch(receivedMessages, receivedCallbacks);
+            }
+            finishBatch();
+        } while (!receivedMessages.empty() || !receivedCallbacks.empty());
+    }
+
+    void ingestUpdate(const UpdateFields& update, uint64_t ticket) {
+        last_update_id = update.update_id;
+        if (update.has_callback && update.has_callback_chat) {
+            receivedCallbacks.push_back({ update.callback_chat_id, batch.store(update.callback_data), batch.store(update.callback_id), update.callback_message_id, ticket, update.update_id });
+        }
+        if (update.has_text && update.has_message_chat) {
+            receivedMessages.push_back({ update.message_chat_id, batch.store(update.text), ticket, update.update_id });
         }
     }
 };
@@ -194,15 +630,17 @@ enum class UserState {
 
 struct BotUser{
     std::string name;
-    std::string id;
+    int64_t id;
     int coins;
     long int scores;
     UserState state;
+    int64_t prompt_message_id = 0;
+    int64_t room_id = 0;
     
-    BotUser(std::string Id, std::string Name) 
-        : id(Id), name(Name), coins(0), scores(0), state(UserState::Idle) {}
+    BotUser(int64_t Id, std::string Name) 
+        : name(Name), id(Id), coins(0), scores(0), state(UserState::Idle) {}
     
-    BotUser() : id(""), name("بازیکن"), coins(0), scores(0), state(UserState::Idle) {}
+    BotUser() : name("بازیکن"), id(0), coins(0), scores(0), state(UserState::Idle) {}
 };
 
 struct BotPlayer{
@@ -213,90 +651,416 @@ struct BotPlayer{
     BotPlayer() : user(), role("") {}
 };
 
-bool isValidFarsiName(const std::string& name) {
-    if (name.length() < 3 || name.length() > 15) {
-        return false;
+struct RoomLink;
+
+// What a handler works on for one chat: the bot that answers it, the tables
+// holding its state, and the way to its rooms.
+struct ChatContext {
+    Bot& bot;
+    FlatTable<BotUser>& users;
+    FlatTable<BotPlayer>& players;
+    RoomLink& rooms;
+};
+
+// Rooms span chats. run(roomId, fn) calls fn with the manager that owns the
+// room (roomId 0: the calling chat's own manager, always inline);
+// back(chat_id, fn) returns to that chat's context; broadcast(chatIds, text)
+// sends text to each chat through the bot of that chat's own context, so
+// it counts against the flood limit its other replies use. With shared
+// state all of them run inline (run under a lock); in shard mode they are
+// messages between shards.
+struct RoomLink {
+    std::function<void(int64_t, std::function<void(RoomManager&)>)> run;
+    std::function<void(int64_t, std::function<void(ChatContext&)>)> back;
+    std::function<void(const std::vector<int64_t>&, std::string_view)> broadcast;
+};
+
+bool isValidFarsiName(std::string_view name) {
+    return isPersianName(name, 3, 15);
+}
+
+const char* const NAME_PROMPT = "👤 لطفا یک نام فارسی بین 3 تا 15 حرف انتخاب کنید. (فقط حروف فارسی، بدون عدد و شکلک)";
+
+// Sends the name prompt and remembers its id, so the confirmation can
+// replace it once the new name arrives.
+Task<> promptForName(Bot& bot, FlatTable<BotUser>& users, int64_t chat_id) {
+    ApiResult prompt = co_await bot.sendMessageAsync(chat_id, NAME_PROMPT);
+    BotUser* user = users.find(chat_id);
+    if (prompt.ok && user && user->state == UserState::WaitingForNewMessage) {
+        user->prompt_message_id = prompt.message_id;
     }
+}
 
-    std::regex farsiRegex(u8"^[\u0600-\u06FF]+$");
-    return std::regex_match(name, farsiRegex);
+// Turns the prompt into the confirmation, or sends the confirmation as a
+// new message when the prompt cannot be edited (gone, or never delivered).
+Task<> confirmRename(Bot& bot, int64_t chat_id, int64_t prompt_message_id, std::string confirmation) {
+    if (prompt_message_id != 0) {
+        ApiResult edited = co_await bot.editMessageTextAsync(chat_id, prompt_message_id, confirmation);
+        if (edited.ok) co_return;
+    }
+    co_await bot.sendMessageAsync(chat_id, confirmation);
 }
 
 
 int main() {
+    Reactor reactor;
     Bot bot("8262579615:AAE97Hz7u-Qa0oUghu4JdfvR6xw2PbxipMU"); 
-    std::map<std::string,BotUser> users;
-    std::map<std::string,BotPlayer> players;
+    // Per-chat state is split by executor bucket, so with several handler
+    // workers each table is only touched by the worker owning its bucket.
+    // Rooms span chats and are shared under a lock.
+    std::vector<FlatTable<BotUser>> userShards(ChatExecutor::BUCKETS);
+    std::vector<FlatTable<BotPlayer>> playerShards(ChatExecutor::BUCKETS);
+    RoomManager rooms;
+    std::mutex roomsMutex;
+    if (const char* pinned = std::getenv("BOT_API_RESOLVE")) {
+        bot.pool.pinResolve(pinned);
+    }
+    bot.warmUp(2);
+
+    WebhookServer webhook;
+    if (const char* port = std::getenv("BOT_WEBHOOK_PORT")) {
+        if (const char* secret = std::getenv("BOT_WEBHOOK_SECRET")) webhook.secretToken = secret;
+        if (const char* path = std::getenv("BOT_WEBHOOK_PATH")) webhook.path = path;
+        if (!webhook.listen("0.0.0.0", std::atoi(port))) {
+            return 1;
+        }
+        if (const char* url = std::getenv("BOT_WEBHOOK_URL")) {
+            bot.setWebhook(url, webhook.secretToken, 40);
+        }
+        bot.attachWebhook(webhook);
+    }
 
-    while (true) {
-        bot.fetchUpdatesOnce();
+    auto handleMessage = [&](ChatContext& ctx, const Bot::Message& msg) {
+        Bot& bot = ctx.bot;
+        int64_t chat_id = msg.chat_id;
+        FlatTable<BotUser>& users = ctx.users;
+        FlatTable<BotPlayer>& players = ctx.players;
+        std::string_view text = msg.text;
+        BotUser* user = users.find(chat_id);
         
-        for (const auto& msg : bot.receivedMessages) {
-            std::string chat_id = msg.chat_id;
-            std::string text = msg.text;
+        if (user && user->state == UserState::WaitingForNewMessage) {
             
-            if (users.count(chat_id) && users[chat_id].state == UserState::WaitingForNewMessage) {
-                
-                if (isValidFarsiName(text)) {
-                    users[chat_id].name = text;
-                    users[chat_id].state = UserState::Idle;
-                    bot.sendMessage(chat_id, "✅ نام شما با موفقیت به " + text + " تغییر یافت.");
-                } else {
-                    bot.sendMessage(chat_id, "❌ نام وارد شده نامعتبر است. لطفا فقط از حروف فارسی (بین 3 تا 15 حرف) استفاده کنید. دوباره تلاش کنید:");
-                }
-                
-            } 
-            else if (text == "/start") {
-                if(users.count(chat_id)){
-                    bot.sendMessage(chat_id,"سلام👋 " + users[chat_id].name);
-                } else {
-                    bot.sendMessage(chat_id,"سلام👋\nبه ربات بازی سیلم خوش آمدید🌹\nمیتوانید با دستور /profile و تغییر نام،اقدام به تغییر نام خود کنید👤");
-                    users.emplace(chat_id, BotUser(chat_id, "بازیکن"));
+            if (isValidFarsiName(text)) {
+                user->name = std::string(text);
+                // Renaming does not take anyone out of their room.
+                user->state = user->room_id != 0 ? UserState::INGAME : UserState::Idle;
+                if (BotPlayer* player = players.find(chat_id)) {
+                    player->user.name = user->name;
                 }
+                std::string confirmation = "✅ نام شما با موفقیت به " + std::string(text) + " تغییر یافت.";
+                confirmRename(bot, chat_id, user->prompt_message_id, std::move(confirmation)).detach();
+                user->prompt_message_id = 0;
+            } else {
+                bot.replyMessage(msg.webhook_ticket, chat_id, "❌ نام وارد شده نامعتبر است. لطفا فقط از حروف فارسی (بین 3 تا 15 حرف) استفاده کنید. دوباره تلاش کنید:");
             }
-            else if(text == "/profile"){
-                std::string profile = "پروفایل بازیکن👤\n\n💢 آیدی: " + msg.chat_id + "\n✏ نام: " + users[msg.chat_id].name + "\n💰 سکه: " + std::to_string(users[msg.chat_id].coins) + "\n⭐ امتیاز: " + std::to_string(users[msg.chat_id].scores);
-                bot.sendGlassBtnMessage(chat_id,profile,{{"تغییر نام", "changeName"},{"تنظیمات بیشتر", "setting"}});
+            
+        } 
+        else if (text == "/start") {
+            if(user){
+                bot.replyMessage(msg.webhook_ticket, chat_id,"سلام👋 " + user->name);
+            } else {
+                bot.replyMessage(msg.webhook_ticket, chat_id,"سلام👋\nبه ربات بازی سیلم خوش آمدید🌹\nمیتوانید با دستور /profile و تغییر نام،اقدام به تغییر نام خود کنید👤");
+                users.emplace(chat_id, BotUser(chat_id, "بازیکن"));
             }
-            else if(text == "/startgame"){
-                users[chat_id].state = UserState::INGAME;
-                BotPlayer player(users[chat_id],"doctor");
-                players[chat_id] = player;
+        }
+        else if(text == "/profile"){
+            BotUser& profileUser = user ? *user : users.emplace(chat_id, BotUser(chat_id, "بازیکن"));
+            std::string profile = "پروفایل بازیکن👤\n\n💢 آیدی: " + std::to_string(chat_id) + "\n✏ نام: " + profileUser.name + "\n💰 سکه: " + std::to_string(profileUser.coins) + "\n⭐ امتیاز: " + std::to_string(profileUser.scores);
+            bot.replyGlassBtnMessage(msg.webhook_ticket, chat_id,profile,{{"تغییر نام", "changeName"},{"تنظیمات بیشتر", "setting"}});
+        }
+        else if(text == "/startgame"){
+            BotUser& gameUser = user ? *user : users.emplace(chat_id, BotUser(chat_id, "بازیکن"));
+            if (gameUser.room_id != 0) {
+                bot.replyMessage(msg.webhook_ticket, chat_id, "⚠ شما در حال حاضر در اتاق " + std::to_string(gameUser.room_id) + " هستید. برای خروج از دستور /leave استفاده کنید.");
+            } else {
+                ctx.rooms.run(0, [&](RoomManager& rooms) {
+                    Room& room = rooms.create(chat_id);
+                    gameUser.room_id = room.id;
+                    gameUser.state = UserState::INGAME;
+                    players[chat_id] = BotPlayer(gameUser,"doctor");
+                    bot.replyMessage(msg.webhook_ticket, chat_id, "🎮 اتاق بازی ساخته شد. کد اتاق: " + std::to_string(room.id) + "\nدوستانتان می‌توانند با دستور /join " + std::to_string(room.id) + " وارد شوند.");
+                });
             }
         }
-            else {
-    if (users[chat_id].state == UserState::INGAME) {
-        std::string senderName = users[chat_id].name;
-        std::string formattedMessage = senderName + ": " + text;
-
-        for (const auto& [key, val] : users) {
-            if (val.state == UserState::INGAME) {
-                bot.sendMessage(val.id, formattedMessage);
+        else if(text.substr(0, 6) == "/join "){
+            BotUser& gameUser = user ? *user : users.emplace(chat_id, BotUser(chat_id, "بازیکن"));
+            int64_t roomId = 0;
+            std::string_view arg = text.substr(6);
+            auto parsed = std::from_chars(arg.data(), arg.data() + arg.size(), roomId);
+            if (gameUser.room_id != 0) {
+                bot.replyMessage(msg.webhook_ticket, chat_id, "⚠ شما در حال حاضر در یک اتاق هستید. برای خروج از دستور /leave استفاده کنید.");
+            } else if (parsed.ec != std::errc() || roomId == 0) {
+                bot.replyMessage(msg.webhook_ticket, chat_id, "❌ اتاقی با این کد پیدا نشد.");
+            } else {
+                // Reserved until the room's owner answers, so a second /join
+                // cannot race this one.
+                gameUser.room_id = roomId;
+                RoomLink& link = ctx.rooms;
+                uint64_t ticket = msg.webhook_ticket;
+                std::string name = gameUser.name;
+                link.run(roomId, [&link, roomId, chat_id, ticket, name](RoomManager& rooms) {
+                    RoomManager::JoinResult result = rooms.join(roomId, chat_id);
+                    if (result == RoomManager::JoinResult::Joined) {
+                        link.broadcast(rooms.find(roomId)->members, "➕ " + name + " وارد اتاق شد.");
+                    }
+                    link.back(chat_id, [roomId, chat_id, ticket, result](ChatContext& chat) {
+                        BotUser* joined = chat.users.find(chat_id);
+                        // Left (or was never reserved) in the meantime.
+                        if (!joined || joined->room_id != roomId) return;
+                        if (result == RoomManager::JoinResult::Joined) {
+                            joined->state = UserState::INGAME;
+                            chat.players[chat_id] = BotPlayer(*joined,"doctor");
+                            return;
+                        }
+                        joined->room_id = 0;
+                        if (result == RoomManager::JoinResult::AlreadyInRoom) {
+                            chat.bot.replyMessage(ticket, chat_id, "⚠ شما در حال حاضر در یک اتاق هستید. برای خروج از دستور /leave استفاده کنید.");
+                        } else if (result == RoomManager::JoinResult::Full) {
+                            chat.bot.replyMessage(ticket, chat_id, "❌ این اتاق پر است.");
+                        } else {
+                            chat.bot.replyMessage(ticket, chat_id, "❌ اتاقی با این کد پیدا نشد.");
+                        }
+                    });
+                });
             }
         }
-    } else {
-        bot.sendMessage(chat_id, text + "؟");
-    }
+        else if(text == "/leave"){
+            if (user && user->room_id != 0) {
+                int64_t roomId = user->room_id;
+                user->room_id = 0;
+                user->state = UserState::Idle;
+                players.erase(chat_id);
+                bot.replyMessage(msg.webhook_ticket, chat_id, "👋 از اتاق خارج شدید.");
+                RoomLink& link = ctx.rooms;
+                link.run(roomId, [&link, chat_id, name = user->name](RoomManager& rooms) {
+                    std::vector<int64_t> remaining = rooms.leave(chat_id);
+                    link.broadcast(remaining, "➖ " + name + " از اتاق خارج شد.");
+                });
+            } else {
+                bot.replyMessage(msg.webhook_ticket, chat_id, "⚠ شما در هیچ اتاقی نیستید.");
+            }
+        }
+        else {
+            if (user && user->state == UserState::INGAME && user->room_id != 0) {
+                int64_t roomId = user->room_id;
+                RoomLink& link = ctx.rooms;
+                link.run(roomId, [&link, roomId, line = user->name + ": " + std::string(text)](RoomManager& rooms) {
+                    if (Room* room = rooms.find(roomId)) {
+                        link.broadcast(room->members, line);
+                    }
+                });
+            } else {
+                bot.sendMessage(chat_id, std::string(text) + "؟");
+            }
+        }
+    };
 
+    auto handleCallback = [&](ChatContext& ctx, const Bot::Callback& cb) {
+        Bot& bot = ctx.bot;
+        int64_t chat_id = cb.chat_id;
+        FlatTable<BotUser>& users = ctx.users;
+        if (cb.data == "changeName") {
+            if(BotUser* user = users.find(chat_id)){
+                user->state = UserState::WaitingForNewMessage;
+                user->prompt_message_id = 0;
+                // Sent as a regular call (not inline) so the prompt's id comes back and can be edited.
+                promptForName(bot, users, chat_id).detach();
+                bot.replyCallbackQuery(cb.webhook_ticket, chat_id, cb.callback_id, "در حال تغییر نام");
+            }
+        } else if (cb.data == "setting") {
+            bot.editMessageText(chat_id, cb.message_id, "شما در تنظیمات هستید:");
+            bot.replyCallbackQuery(cb.webhook_ticket, chat_id, cb.callback_id, "تنظیمات بیشتر");
         }
+    };
 
-        for (const auto& cb : bot.receivedCallbacks) {
-            if (cb.data == "changeName") {
-                if(users.count(cb.chat_id)){
-                    users[cb.chat_id].state = UserState::WaitingForNewMessage;
-                    bot.sendMessage(cb.chat_id, "👤 لطفا یک نام فارسی بین 3 تا 15 حرف انتخاب کنید. (فقط حروف فارسی، بدون عدد و شکلک)");
-                    bot.answerCallbackQuery(cb.callback_id,"در حال تغییر نام");
-                }
-            } else if (cb.data == "setting") {
-                bot.editMessageText(cb.chat_id, cb.message_id, "شما در تنظیمات هستید:");
-                bot.answerCallbackQuery(cb.callback_id,"تنظیمات بیشتر");
+    RoomLink sharedRooms;
+    auto sharedContext = [&](int64_t chat_id) {
+        size_t bucket = ChatExecutor::bucketOf(chat_id);
+        return ChatContext{ bot, userShards[bucket], playerShards[bucket], sharedRooms };
+    };
+    sharedRooms.run = [&](int64_t, std::function<void(RoomManager&)> fn) {
+        std::lock_guard<std::mutex> lock(roomsMutex);
+        fn(rooms);
+    };
+    sharedRooms.back = [&](int64_t chat_id, std::function<void(ChatContext&)> fn) {
+        ChatContext chat = sharedContext(chat_id);
+        fn(chat);
+    };
+    // Room broadcasts take no done, so they are not tied to a chat.
+    sharedRooms.broadcast = [&](const std::vector<int64_t>& chatIds, std::string_view text) {
+        bot.broadcastMessage(0, chatIds, text);
+    };
+
+    bot.onBatch = [&](const std::vector<Bot::Message>& messages, const std::vector<Bot::Callback>& callbacks) {
+        Bot::forEachInOrder(messages, callbacks, [&](size_t i) {
+            ChatContext ctx = sharedContext(messages[i].chat_id);
+            handleMessage(ctx, messages[i]);
+        }, [&](size_t i) {
+            ChatContext ctx = sharedContext(callbacks[i].chat_id);
+            handleCallback(ctx, callbacks[i]);
+        });
+    };
+
+    // BOT_SHARDS=N (long polling only): shared-nothing mode. Each of N
+    // shard threads owns the users, players and rooms of its chats plus its
+    // own loop and Bot (connections, rate limiter); this thread only fetches
+    // updates and hands each to its chat's shard. A room lives on its
+    // creator's shard, and members on other shards reach it by message.
+    size_t shardCount = 0;
+    if (const char* count = std::getenv("BOT_SHARDS")) {
+        shardCount = std::strtoul(count, nullptr, 10);
+    }
+    if (shardCount > 1 && webhook.fd() < 0) {
+        struct ChatShard {
+            std::unique_ptr<Bot> bot;
+            FlatTable<BotUser> users;
+            FlatTable<BotPlayer> players;
+            RoomManager rooms;
+            RoomLink link;
+        };
+        // Declared before the shard threads so it outlives them.
+        std::vector<std::unique_ptr<ChatShard>> owned;
+        ShardSet shards(shardCount);
+        auto shardOf = [shardCount](int64_t chat_id) {
+            return ChatExecutor::bucketOf(chat_id) % shardCount;
+        };
+        auto contextOf = [&owned](size_t index) {
+            ChatShard& shard = *owned[index];
+            return ChatContext{ *shard.bot, shard.users, shard.players, shard.link };
+        };
+        for (size_t i = 0; i < shardCount; ++i) {
+            owned.push_back(std::make_unique<ChatShard>());
+            ChatShard& shard = *owned.back();
+            shard.bot = std::make_unique<Bot>(bot.token);
+            if (const char* pinned = std::getenv("BOT_API_RESOLVE")) {
+                shard.bot->pool.pinResolve(pinned);
             }
+            // The global flood limit is per bot token, so the shards split it.
+            RateLimiter::Limits limits;
+            limits.globalPerSecond /= shardCount;
+            limits.globalBurst = std::max(1.0, limits.globalBurst / shardCount);
+            shard.bot->limiter.configure(limits);
+            shard.bot->warmUp(1);
+            shard.rooms.idStride = shardCount;
+            shard.rooms.idOffset = i;
+            shard.link.run = [&owned, &shards, shardCount, i](int64_t roomId, std::function<void(RoomManager&)> fn) {
+                size_t owner = roomId == 0 ? i : (size_t)roomId % shardCount;
+                if (owner == i) {
+                    fn(owned[i]->rooms);
+                    return;
+                }
+                shards.post(owner, [&owned, owner, fn = std::move(fn)]() {
+                    fn(owned[owner]->rooms);
+                });
+            };
+            shard.link.back = [&shards, shardOf, contextOf](int64_t chat_id, std::function<void(ChatContext&)> fn) {
+                size_t home = shardOf(chat_id);
+                auto deliver = [contextOf, home, fn = std::move(fn)]() {
+                    ChatContext chat = contextOf(home);
+                    fn(chat);
+                };
+                if (home == ShardSet::current()) {
+                    deliver();
+                } else {
+                    shards.post(home, std::move(deliver));
+                }
+            };
+            // Called from whichever shard owns the room; members are
+            // grouped by home shard so the text is still serialised once
+            // per shard rather than once per member.
+            shard.link.broadcast = [&owned, &shards, shardCount, shardOf](const std::vector<int64_t>& chatIds, std::string_view text) {
+                std::vector<std::vector<int64_t>> byShard(shardCount);
+                for (int64_t chatId : chatIds) {
+                    byShard[shardOf(chatId)].push_back(chatId);
+                }
+                auto line = std::make_shared<std::string>(text);
+                for (size_t home = 0; home < shardCount; ++home) {
+                    if (byShard[home].empty()) continue;
+                    if (home == ShardSet::current()) {
+                        owned[home]->bot->broadcastMessage(0, byShard[home], *line);
+                        continue;
+                    }
+                    shards.post(home, [&owned, home, members = std::move(byShard[home]), line]() {
+                        owned[home]->bot->broadcastMessage(0, members, *line);
+                    });
+                }
+            };
+        }
+        shards.start([&owned](size_t index, Reactor& loop) {
+            owned[index]->bot->attachReactor(loop, false);
+        });
+
+        Bot::InboundBatch item;
+        for (;;) {
+            if (!bot.takeBatch(item)) continue;
+            // Shared by the jobs reading views into its storage.
+            auto batch = std::make_shared<Bot::InboundBatch>(std::move(item));
+            item = Bot::InboundBatch();
+            Bot::forEachInOrder(batch->messages, batch->callbacks, [&](size_t i) {
+                size_t home = shardOf(batch->messages[i].chat_id);
+                shards.send(home, [&handleMessage, contextOf, batch, home, i]() {
+                    ChatContext ctx = contextOf(home);
+                    handleMessage(ctx, batch->messages[i]);
+                });
+            }, [&](size_t i) {
+                size_t home = shardOf(batch->callbacks[i].chat_id);
+                shards.send(home, [&handleCallback, contextOf, batch, home, i]() {
+                    ChatContext ctx = contextOf(home);
+                    handleCallback(ctx, batch->callbacks[i]);
+                });
+            });
         }
+    }
 
-        bot.receivedMessages.clear();
-        bot.receivedCallbacks.clear();
-        sleep(1);
+    // BOT_PIPELINE (long polling only): a second Bot fetches on its own
+    // thread, handlers run on workers, and this thread only sends. With
+    // more than one worker (BOT_HANDLER_THREADS, default: one per core)
+    // the handler thread only splits batches by chat onto a ChatExecutor.
+    std::unique_ptr<Bot> fetcher;
+    std::unique_ptr<ChatExecutor> workers;
+    std::unique_ptr<Pipeline<Bot::InboundBatch>> pipeline;
+    if (std::getenv("BOT_PIPELINE") && webhook.fd() < 0) {
+        fetcher = std::make_unique<Bot>(bot.token);
+        fetcher->pollConfig = bot.pollConfig;
+        pipeline = std::make_unique<Pipeline<Bot::InboundBatch>>(reactor);
+        bot.attachReactor(reactor, false);
+        bot.attachPipeline(*pipeline);
+        size_t handlerThreads = std::thread::hardware_concurrency();
+        if (const char* threads = std::getenv("BOT_HANDLER_THREADS")) {
+            handlerThreads = std::strtoul(threads, nullptr, 10);
+        }
+        if (handlerThreads > 1) {
+            workers = std::make_unique<ChatExecutor>(handlerThreads);
+            bot.attachExecutor(*workers);
+        }
+        pipeline->start([&fetcher](Bot::InboundBatch& item) {
+            return fetcher->takeBatch(item);
+        }, [&](Bot::InboundBatch& item) {
+            if (!workers) {
+                bot.onBatch(item.messages, item.callbacks);
+                return;
+            }
+            // The views in item point into its storage, which has to
+            // outlive every job that reads from it.
+            auto shared = std::make_shared<Bot::InboundBatch>(std::move(item));
+            item = Bot::InboundBatch();
+            Bot::forEachInOrder(shared->messages, shared->callbacks, [&](size_t i) {
+                workers->submit(shared->messages[i].chat_id, [&, shared, i]() {
+                    ChatContext ctx = sharedContext(shared->messages[i].chat_id);
+                    handleMessage(ctx, shared->messages[i]);
+                });
+            }, [&](size_t i) {
+                workers->submit(shared->callbacks[i].chat_id, [&, shared, i]() {
+                    ChatContext ctx = sharedContext(shared->callbacks[i].chat_id);
+                    handleCallback(ctx, shared->callbacks[i]);
+                });
+            });
+            workers->rebalance();
+        });
+    } else {
+        bot.attachReactor(reactor);
     }
+    reactor.run();
 
     return 0;
 }
@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "reactor.hpp"
+#include "ring_buffer.hpp"
+
+// Three stages connected by lock-free rings:
+//   ingest thread  --inbound (SPSC)-->  handler thread  --outbound (MPMC)-->  sender loop
+// The ingest thread repeatedly calls fetch() to fill an Item (e.g. one
+// getUpdates batch), the handler thread runs handle() on each Item, and
+// calls passed to send() run on the Reactor that owns the outbound
+// transport. A full ring blocks the stage feeding it. Work posted back from
+// the sender with complete() (API results) runs on the handler thread and
+// never waits on capacity, so the sender never waits on the handler.
+template <typename Item>
+class Pipeline {
+public:
+    using Fetch = std::function<bool(Item&)>;
+    using Handle = std::function<void(Item&)>;
+    using Call = std::function<void()>;
+
+    struct Stats {
+        size_t inboundDepth;
+        size_t inboundHighWater;
+        uint64_t inboundStalls;
+        size_t outboundDepth;
+        size_t outboundHighWater;
+        uint64_t outboundStalls;
+        uint64_t fetched;
+        uint64_t handled;
+        uint64_t sent;
+    };
+
+    // Calls drained from the outbound queue per wakeup of the sender loop.
+    size_t drainBatch = 256;
+
+    // Must be constructed on the thread that runs senderLoop.
+    explicit Pipeline(Reactor& senderLoop, size_t inboundCapacity = 64, size_t outboundCapacity = 4096)
+        : loop(senderLoop), inbound(inboundCapacity), outbound(outboundCapacity), replies(outboundCapacity) {
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeFd < 0) {
+            std::cerr << "Pipeline eventfd error: " << std::strerror(errno) << std::endl;
+            return;
+        }
+        loop.watch(wakeFd, EPOLLIN, [this](uint32_t) {
+            drainOutbound();
+        });
+    }
+
+    ~Pipeline() {
+        stop();
+        if (wakeFd >= 0) {
+            loop.unwatch(wakeFd);
+            ::close(wakeFd);
+        }
+    }
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    void start(Fetch fetch, Handle handle) {
+        ingestThread = std::thread([this, fetch = std::move(fetch)]() {
+            runIngest(fetch);
+        });
+        handlerThread = std::thread([this, handle = std::move(handle)]() {
+            runHandler(handle);
+        });
+    }
+
+    // From any thread other than the sender loop's; blocks while the
+    // outbound ring is full.
+    void send(Call call) {
+        if (!outbound.tryPush(call)) {
+            ++outboundStalls;
+            bool pushed = false;
+            outboundSpace.wait([&]() {
+                pushed = outbound.tryPush(call);
+                return pushed || stopping;
+            });
+            if (!pushed) return;
+        }
+        noteDepth(outboundHighWater, outbound.size());
+        wake();
+    }
+
+    // Sender loop only.
+    void complete(Call call) {
+        if (!replies.tryPush(call)) {
+            std::lock_guard<std::mutex> lock(overflowMutex);
+            overflow.push_back(std::move(call));
+            overflowCount = overflow.size();
+        }
+        handlerReady.notify();
+    }
+
+    // Joins the threads. The ingest thread finishes the fetch it is in
+    // first (up to one long-poll timeout).
+    void stop() {
+        stopping = true;
+        handlerReady.notify();
+        ingestSpace.notify();
+        outboundSpace.notify();
+        if (ingestThread.joinable()) ingestThread.join();
+        if (handlerThread.joinable()) handlerThread.join();
+    }
+
+    Stats stats() const {
+        return {
+            inbound.size(), inboundHighWater.load(), inboundStalls.load(),
+            outbound.size(), outboundHighWater.load(), outboundStalls.load(),
+            fetched.load(), handled.load(), sent.load()
+        };
+    }
+
+private:
+    Reactor& loop;
+    SpscRing<Item> inbound;
+    MpmcRing<Call> outbound;
+    // complete() results: the sender loop is the only producer. If the ring
+    // is full the rest spill into the overflow list rather than blocking.
+    SpscRing<Call> replies;
+    std::mutex overflowMutex;
+    std::vector<Call> overflow;
+    std::atomic<size_t> overflowCount{ 0 };
+    Parker handlerReady;
+    Parker ingestSpace;
+    Parker outboundSpace;
+    int wakeFd = -1;
+    std::thread ingestThread;
+    std::thread handlerThread;
+    std::atomic<bool> stopping{ false };
+    std::atomic<size_t> inboundHighWater{ 0 };
+    std::atomic<size_t> outboundHighWater{ 0 };
+    std::atomic<uint64_t> inboundStalls{ 0 };
+    std::atomic<uint64_t> outboundStalls{ 0 };
+    std::atomic<uint64_t> fetched{ 0 };
+    std::atomic<uint64_t> handled{ 0 };
+    std::atomic<uint64_t> sent{ 0 };
+    // Handled items go back to the ingest thread so their buffers are reused.
+    std::mutex spareMutex;
+    std::vector<Item> spare;
+
+    void wake() {
+        uint64_t one = 1;
+        if (::write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            std::cerr << "Pipeline wake error: " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    void drainOutbound() {
+        uint64_t count;
+        while (::read(wakeFd, &count, sizeof(count)) > 0) {}
+        Call calls[64];
+        size_t drained = 0;
+        while (drained < drainBatch) {
+            size_t n = outbound.popBatch(calls, std::min<size_t>(64, drainBatch - drained));
+            if (n == 0) break;
+            outboundSpace.notify();
+            for (size_t i = 0; i < n; ++i) {
+                calls[i]();
+                calls[i] = nullptr;
+            }
+            drained += n;
+        }
+        sent += drained;
+        if (drained == drainBatch) {
+            wake();
+        }
+    }
+
+    static void noteDepth(std::atomic<size_t>& highWater, size_t depth) {
+        size_t seen = highWater.load(std::memory_order_relaxed);
+        while (depth > seen && !highWater.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {}
+    }
+
+    void runIngest(const Fetch& fetch) {
+        while (!stopping) {
+            Item item = takeSpare();
+            if (!fetch(item)) {
+                giveSpare(std::move(item));
+                continue;
+            }
+            ++fetched;
+            if (!inbound.tryPush(item)) {
+                ++inboundStalls;
+                bool pushed = false;
+                ingestSpace.wait([&]() {
+                    pushed = inbound.tryPush(item);
+                    return pushed || stopping;
+                });
+                if (!pushed) break;
+            }
+            noteDepth(inboundHighWater, inbound.size());
+            handlerReady.notify();
+        }
+    }
+
+    void runHandler(const Handle& handle) {
+        Item item;
+        for (;;) {
+            handlerReady.wait([this]() {
+                return stopping || inbound.size() > 0 || replies.size() > 0 || overflowCount > 0;
+            });
+            runReplies();
+            if (inbound.tryPop(item)) {
+                ingestSpace.notify();
+                handle(item);
+                ++handled;
+                giveSpare(std::move(item));
+                item = Item();
+            } else if (stopping) {
+                break;
+            }
+        }
+    }
+
+    void runReplies() {
+        Call call;
+        while (replies.tryPop(call)) {
+            call();
+            call = nullptr;
+        }
+        if (overflowCount == 0) return;
+        std::vector<Call> spilled;
+        {
+            std::lock_guard<std::mutex> lock(overflowMutex);
+            spilled.swap(overflow);
+            overflowCount = 0;
+        }
+        for (Call& pending : spilled) {
+            pending();
+        }
+    }
+
+    Item takeSpare() {
+        std::lock_guard<std::mutex> lock(spareMutex);
+        if (spare.empty()) return Item();
+        Item item = std::move(spare.back());
+        spare.pop_back();
+        return item;
+    }
+
+    void giveSpare(Item item) {
+        std::lock_guard<std::mutex> lock(spareMutex);
+        if (spare.size() < inbound.capacity()) {
+            spare.push_back(std::move(item));
+        }
+    }
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+#include "flat_table.hpp"
+
+struct TokenBucket {
+    using Clock = std::chrono::steady_clock;
+
+    double rate = 1;
+    double burst = 1;
+    double tokens = 1;
+    Clock::time_point last = Clock::now();
+
+    void configure(double perSecond, double capacity) {
+        rate = perSecond;
+        burst = capacity;
+        tokens = capacity;
+        last = Clock::now();
+    }
+
+    void refill(Clock::time_point now) {
+        double elapsed = std::chrono::duration<double>(now - last).count();
+        if (elapsed > 0) {
+            tokens = std::min(burst, tokens + elapsed * rate);
+            last = now;
+        }
+    }
+
+    double secondsUntil(double needed) const {
+        return needed <= tokens ? 0.0 : (needed - tokens) / rate;
+    }
+
+    bool full() const {
+        return tokens >= burst;
+    }
+};
+
+// Outbound scheduler matching Telegram's flood limits: one global bucket
+// (~30 msg/s) plus a bucket per chat (~1 msg/s for private chats, 20/min
+// for groups, whose ids are negative). Jobs that cannot go out yet wait in
+// per-chat FIFOs that are served round-robin, so one busy room cannot
+// starve everybody else. Chat 0 is for calls not tied to a chat (e.g.
+// answerCallbackQuery) and only draws from the global bucket.
+class RateLimiter {
+public:
+    using Clock = TokenBucket::Clock;
+    using Job = std::function<void()>;
+
+    struct Limits {
+        double globalPerSecond = 30;
+        double globalBurst = 30;
+        double privatePerSecond = 1;
+        double privateBurst = 3;
+        double groupPerSecond = 20.0 / 60.0;
+        double groupBurst = 3;
+    };
+
+    size_t dispatched = 0;
+    size_t delayed = 0;
+
+    RateLimiter() {
+        configure(limits);
+    }
+
+    void configure(Limits updated) {
+        limits = updated;
+        global.configure(limits.globalPerSecond, limits.globalBurst);
+    }
+
+    // Takes a token for chatId right now if nothing is queued ahead of it.
+    bool tryAcquire(int64_t chatId) {
+        Clock::time_point now = Clock::now();
+        global.refill(now);
+        ChatState& chat = stateFor(chatId, now);
+        chat.bucket.refill(now);
+        if (!chat.queue.empty() || global.tokens < 1 || chat.bucket.tokens < 1) return false;
+        global.tokens -= 1;
+        chat.bucket.tokens -= 1;
+        ++dispatched;
+        return true;
+    }
+
+    // Runs job immediately when the limits allow it, otherwise queues it
+    // for pump().
+    void submit(int64_t chatId, Job job) {
+        if (tryAcquire(chatId)) {
+            job();
+            return;
+        }
+        ++delayed;
+        ChatState& chat = *chats.find(chatId);
+        chat.queue.push_back(std::move(job));
+        ++queued;
+        if (!chat.active) {
+            chat.active = true;
+            activeChats.push_back(chatId);
+        }
+    }
+
+    // Releases every job whose chat and the global bucket allow it.
+    void pump() {
+        Clock::time_point now = Clock::now();
+        global.refill(now);
+        bool progressed = true;
+        while (progressed && !activeChats.empty() && global.tokens >= 1) {
+            progressed = false;
+            for (size_t n = activeChats.size(); n > 0 && global.tokens >= 1; --n) {
+                int64_t chatId = activeChats.front();
+                activeChats.pop_front();
+                ChatState* chat = chats.find(chatId);
+                if (!chat) continue;
+                chat->bucket.refill(now);
+                if (chat->bucket.tokens >= 1) {
+                    Job job = std::move(chat->queue.front());
+                    chat->queue.pop_front();
+                    --queued;
+                    global.tokens -= 1;
+                    chat->bucket.tokens -= 1;
+                    ++dispatched;
+                    progressed = true;
+                    job();
+                    chat = chats.find(chatId);
+                }
+                if (chat && !chat->queue.empty()) {
+                    activeChats.push_back(chatId);
+                } else if (chat) {
+                    chat->active = false;
+                }
+            }
+        }
+        if (now - lastSweep > std::chrono::seconds(30)) {
+            sweep(now);
+        }
+    }
+
+    // Keeps chatId silent for delay (a 429 retry_after); its next token
+    // becomes available exactly when the delay runs out.
+    void holdOff(int64_t chatId, std::chrono::milliseconds delay) {
+        Clock::time_point now = Clock::now();
+        ChatState& chat = stateFor(chatId, now);
+        chat.bucket.refill(now);
+        double seconds = std::chrono::duration<double>(delay).count();
+        chat.bucket.tokens = std::min(chat.bucket.tokens, 1.0 - seconds * chat.bucket.rate);
+    }
+
+    size_t pending() const {
+        return queued;
+    }
+
+    // How long a message submitted to chatId now would wait.
+    std::chrono::milliseconds expectedDelay(int64_t chatId) const {
+        Clock::time_point now = Clock::now();
+        TokenBucket globalNow = global;
+        globalNow.refill(now);
+        double wait = globalNow.secondsUntil((double)queued + 1);
+        const ChatState* chat = chats.find(chatId);
+        if (chat) {
+            TokenBucket chatNow = chat->bucket;
+            chatNow.refill(now);
+            wait = std::max(wait, chatNow.secondsUntil((double)chat->queue.size() + 1));
+        }
+        return std::chrono::milliseconds((long long)(wait * 1000.0 + 0.5));
+    }
+
+    // Milliseconds until pump() can release the next queued job; -1 when idle.
+    int msUntilReady() const {
+        if (activeChats.empty()) return -1;
+        Clock::time_point now = Clock::now();
+        TokenBucket globalNow = global;
+        globalNow.refill(now);
+        double best = -1;
+        for (int64_t chatId : activeChats) {
+            const ChatState* chat = chats.find(chatId);
+            if (!chat) continue;
+            TokenBucket chatNow = chat->bucket;
+            chatNow.refill(now);
+            double wait = std::max(globalNow.secondsUntil(1), chatNow.secondsUntil(1));
+            if (best < 0 || wait < best) best = wait;
+        }
+        return best < 0 ? -1 : (int)(best * 1000.0) + 1;
+    }
+
+private:
+    struct ChatState {
+        TokenBucket bucket;
+        std::deque<Job> queue;
+        bool active = false;
+    };
+
+    Limits limits;
+    TokenBucket global;
+    FlatTable<ChatState> chats;
+    std::deque<int64_t> activeChats;
+    size_t queued = 0;
+    Clock::time_point lastSweep = Clock::now();
+
+    ChatState& stateFor(int64_t chatId, Clock::time_point now) {
+        if (ChatState* chat = chats.find(chatId)) return *chat;
+        ChatState& chat = chats.emplace(chatId, ChatState());
+        if (chatId == 0) {
+            chat.bucket.configure(1e9, 1e9);
+        } else if (chatId < 0) {
+            chat.bucket.configure(limits.groupPerSecond, limits.groupBurst);
+        } else {
+            chat.bucket.configure(limits.privatePerSecond, limits.privateBurst);
+        }
+        chat.bucket.last = now;
+        return chat;
+    }
+
+    // Drops state for idle chats whose bucket has refilled completely; a
+    // fresh bucket for them would be identical.
+    void sweep(Clock::time_point now) {
+        lastSweep = now;
+        std::vector<int64_t> idle;
+        for (auto& [chatId, chat] : chats) {
+            chat.bucket.refill(now);
+            if (!chat.active && chat.queue.empty() && chat.bucket.full()) {
+                idle.push_back(chatId);
+            }
+        }
+        for (int64_t chatId : idle) {
+            chats.erase(chatId);
+        }
+    }
+};
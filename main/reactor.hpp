@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include "flat_table.hpp"
+#include "timer_queue.hpp"
+
+// Single-threaded event loop: fd readiness through epoll, one-shot timers,
+// and hooks that run before every wait (each returns how soon it wants to
+// run again, or -1). Handlers may watch/unwatch freely, including their own
+// fd, while events are being dispatched.
+class Reactor {
+public:
+    using IoHandler = std::function<void(uint32_t events)>;
+    using Hook = std::function<int()>;
+
+    TimerQueue timers;
+
+    Reactor() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            std::cerr << "Reactor epoll error: " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    ~Reactor() {
+        if (epollFd >= 0) ::close(epollFd);
+    }
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    bool watch(int fd, uint32_t events, IoHandler handler) {
+        struct epoll_event ev = {};
+        ev.events = events;
+        ev.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            std::cerr << "Reactor watch error: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        auto watcher = std::make_unique<Watcher>();
+        watcher->handler = std::move(handler);
+        watchers.emplace(fd, std::move(watcher));
+        return true;
+    }
+
+    bool modify(int fd, uint32_t events) {
+        struct epoll_event ev = {};
+        ev.events = events;
+        ev.data.fd = fd;
+        return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == 0;
+    }
+
+    bool watching(int fd) const {
+        return watchers.contains(fd);
+    }
+
+    void unwatch(int fd) {
+        std::unique_ptr<Watcher>* watcher = watchers.find(fd);
+        if (!watcher) return;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+        // Kept alive until the current dispatch round ends; the handler may
+        // be the one running right now.
+        retired.push_back(std::move(*watcher));
+        watchers.erase(fd);
+    }
+
+    void addHook(Hook hook) {
+        hooks.push_back(std::move(hook));
+    }
+
+    // One round: hooks, a wait of at most maxWaitMs (-1 = until something
+    // happens), fd handlers, due timers.
+    void runOnce(int maxWaitMs) {
+        int timeoutMs = maxWaitMs;
+        for (Hook& hook : hooks) {
+            capTimeout(timeoutMs, hook());
+        }
+        capTimeout(timeoutMs, timers.msUntilNext());
+
+        struct epoll_event events[64];
+        int count = epoll_wait(epollFd, events, 64, timeoutMs);
+        if (count < 0 && errno != EINTR) {
+            std::cerr << "Reactor epoll_wait error: " << std::strerror(errno) << std::endl;
+        }
+        for (int i = 0; i < count; ++i) {
+            std::unique_ptr<Watcher>* watcher = watchers.find(events[i].data.fd);
+            if (watcher) {
+                (*watcher)->handler(events[i].events);
+            }
+        }
+        timers.runDue();
+        retired.clear();
+    }
+
+    void run() {
+        running = true;
+        while (running) {
+            runOnce(-1);
+        }
+    }
+
+    void stop() {
+        running = false;
+    }
+
+private:
+    struct Watcher {
+        IoHandler handler;
+    };
+
+    int epollFd = -1;
+    bool running = false;
+    FlatTable<std::unique_ptr<Watcher>> watchers;
+    std::vector<std::unique_ptr<Watcher>> retired;
+    std::vector<Hook> hooks;
+
+    static void capTimeout(int& timeoutMs, int deadlineMs) {
+        if (deadlineMs >= 0 && (timeoutMs < 0 || deadlineMs < timeoutMs)) {
+            timeoutMs = deadlineMs;
+        }
+    }
+};
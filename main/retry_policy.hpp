@@ -0,0 +1,38 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include "send_engine.hpp"
+
+// Which failed sends are tried again and how long to wait before doing so.
+struct RetryPolicy {
+    int maxAttempts = 5;
+    int baseDelayMs = 500;
+    int maxDelayMs = 30000;
+
+    // 429 and 5xx replies, plus transport errors that happen before the
+    // request can have reached the API (so a retry cannot double-send).
+    static bool retryable(const SendResult& result) {
+        switch (result.curl_code) {
+            case CURLE_OK:
+                return result.http_status == 429 || result.http_status >= 500;
+            case CURLE_COULDNT_RESOLVE_HOST:
+            case CURLE_COULDNT_CONNECT:
+            case CURLE_SSL_CONNECT_ERROR:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Exponential backoff with "equal jitter": half the step is fixed, the
+    // other half random, so retries from a burst of failures spread out.
+    std::chrono::milliseconds backoff(int attempt, std::minstd_rand& rng) const {
+        long step = baseDelayMs;
+        for (int i = 1; i < attempt && step < maxDelayMs; ++i) step *= 2;
+        step = std::min<long>(step, maxDelayMs);
+        std::uniform_int_distribution<long> jitter(0, step / 2);
+        return std::chrono::milliseconds(step - step / 2 + jitter(rng));
+    }
+};
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+inline size_t ringCapacity(size_t requested) {
+    size_t capacity = 2;
+    while (capacity < requested) capacity <<= 1;
+    return capacity;
+}
+
+// Bounded single-producer/single-consumer ring. Each side owns its index on
+// its own cache line and keeps a cached copy of the other side's index, so
+// the shared lines are only touched when the cached view says full/empty.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : mask(ringCapacity(capacity) - 1), slots(new T[mask + 1]) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Moves from item only on success.
+    bool tryPush(T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cachedHead > mask) {
+            cachedHead = head.load(std::memory_order_acquire);
+            if (t - cachedHead > mask) return false;
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Pushes as many of items[0..count) as fit; returns how many.
+    size_t pushBatch(T* items, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t room = mask + 1 - (t - cachedHead);
+        if (room < count) {
+            cachedHead = head.load(std::memory_order_acquire);
+            room = mask + 1 - (t - cachedHead);
+        }
+        size_t n = count < room ? count : room;
+        for (size_t i = 0; i < n; ++i) {
+            slots[(t + i) & mask] = std::move(items[i]);
+        }
+        tail.store(t + n, std::memory_order_release);
+        return n;
+    }
+
+    bool tryPop(T& out) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(std::memory_order_acquire);
+            if (h == cachedTail) return false;
+        }
+        out = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t popBatch(T* out, size_t max) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (cachedTail - h < max) {
+            cachedTail = tail.load(std::memory_order_acquire);
+        }
+        size_t available = cachedTail - h;
+        size_t n = max < available ? max : available;
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = std::move(slots[(h + i) & mask]);
+        }
+        head.store(h + n, std::memory_order_release);
+        return n;
+    }
+
+    // Approximate when read by a third thread.
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    const size_t mask;
+    std::unique_ptr<T[]> slots;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail{ 0 };
+    size_t cachedHead = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head{ 0 };
+    size_t cachedTail = 0;
+};
+
+// Bounded multi-producer/multi-consumer ring (Vyukov's sequence-numbered
+// cells): one CAS per operation on the shared position, or per batch for
+// pushBatch/popBatch, no locks. Cells sit on their own cache lines so
+// neighbouring slots do not false-share.
+template <typename T>
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacity) : mask(ringCapacity(capacity) - 1), cells(new Cell[mask + 1]) {
+        for (size_t i = 0; i <= mask; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    // Moves from item only on success.
+    bool tryPush(T& item) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& out) {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.value);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Claims the run of free cells at the tail with a single CAS, then
+    // fills it; pushes as many of items[0..count) as fit and returns how
+    // many. Only the claimed cells' owner can touch them until they are
+    // published, so the run stays valid between the scan and the CAS.
+    size_t pushBatch(T* items, size_t count) {
+        if (count == 0) return 0;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t n = 0;
+            while (n < count && n <= mask && cells[(pos + n) & mask].sequence.load(std::memory_order_acquire) == pos + n) ++n;
+            if (n == 0) {
+                intptr_t diff = (intptr_t)cells[pos & mask].sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+                if (diff < 0) return 0;
+                pos = enqueuePos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (!enqueuePos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) continue;
+            for (size_t i = 0; i < n; ++i) {
+                Cell& cell = cells[(pos + i) & mask];
+                cell.value = std::move(items[i]);
+                cell.sequence.store(pos + i + 1, std::memory_order_release);
+            }
+            return n;
+        }
+    }
+
+    // Same for the consumer side: one CAS takes the run of published cells
+    // at the head (up to max).
+    size_t popBatch(T* out, size_t max) {
+        if (max == 0) return 0;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t n = 0;
+            while (n < max && n <= mask && cells[(pos + n) & mask].sequence.load(std::memory_order_acquire) == pos + n + 1) ++n;
+            if (n == 0) {
+                intptr_t diff = (intptr_t)cells[pos & mask].sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+                if (diff < 0) return 0;
+                pos = dequeuePos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (!dequeuePos.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)) continue;
+            for (size_t i = 0; i < n; ++i) {
+                Cell& cell = cells[(pos + i) & mask];
+                out[i] = std::move(cell.value);
+                cell.sequence.store(pos + i + mask + 1, std::memory_order_release);
+            }
+            return n;
+        }
+    }
+
+    size_t size() const {
+        size_t in = enqueuePos.load(std::memory_order_acquire);
+        size_t out = dequeuePos.load(std::memory_order_acquire);
+        return in > out ? in - out : 0;
+    }
+
+    size_t capacity() const {
+        return mask + 1;
+    }
+
+private:
+    struct alignas(CACHE_LINE_SIZE) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> enqueuePos{ 0 };
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> dequeuePos{ 0 };
+};
+
+// Blocking hook for the rings: a thread waits until ready() holds, spinning
+// briefly before it sleeps; notify() only takes the mutex when somebody is
+// actually asleep, so the fast path stays lock-free.
+class Parker {
+public:
+    template <typename Ready>
+    void wait(Ready ready) {
+        for (int spin = 0; spin < 64; ++spin) {
+            if (ready()) return;
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wakeup.wait(lock, ready);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Call after making ready() true.
+    void notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_seq_cst) == 0) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        wakeup.notify_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wakeup;
+    std::atomic<int> sleepers{ 0 };
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "flat_table.hpp"
+
+struct Room {
+    int64_t id = 0;
+    int64_t owner = 0;
+    std::vector<int64_t> members;
+};
+
+// Game rooms and the chat -> room index, so a relay touches only the
+// sender's room instead of every registered user.
+class RoomManager {
+public:
+    enum class JoinResult {
+        Joined,
+        NoSuchRoom,
+        Full,
+        AlreadyInRoom
+    };
+
+    size_t maxMembers = 20;
+    // Ids are nextRoomId * idStride + idOffset, so several managers (one
+    // per shard) hand out disjoint ids and id % idStride names the owner.
+    int64_t idStride = 1;
+    int64_t idOffset = 0;
+
+    Room& create(int64_t owner) {
+        int64_t id = nextRoomId++ * idStride + idOffset;
+        Room& room = rooms.emplace(id, Room());
+        room.id = id;
+        room.owner = owner;
+        room.members.push_back(owner);
+        memberRoom.emplace(owner, id);
+        return room;
+    }
+
+    Room* find(int64_t roomId) {
+        return rooms.find(roomId);
+    }
+
+    Room* roomOf(int64_t chatId) {
+        int64_t* roomId = memberRoom.find(chatId);
+        return roomId ? rooms.find(*roomId) : nullptr;
+    }
+
+    JoinResult join(int64_t roomId, int64_t chatId) {
+        if (memberRoom.contains(chatId)) return JoinResult::AlreadyInRoom;
+        Room* room = rooms.find(roomId);
+        if (!room) return JoinResult::NoSuchRoom;
+        if (room->members.size() >= maxMembers) return JoinResult::Full;
+        room->members.push_back(chatId);
+        memberRoom.emplace(chatId, roomId);
+        return JoinResult::Joined;
+    }
+
+    // Removes chatId from its room and returns the members left behind
+    // (empty when the room was closed or the chat was in no room).
+    std::vector<int64_t> leave(int64_t chatId) {
+        int64_t* roomIdPtr = memberRoom.find(chatId);
+        if (!roomIdPtr) return {};
+        int64_t roomId = *roomIdPtr;
+        memberRoom.erase(chatId);
+        Room* room = rooms.find(roomId);
+        if (!room) return {};
+        auto& members = room->members;
+        members.erase(std::remove(members.begin(), members.end(), chatId), members.end());
+        if (members.empty()) {
+            rooms.erase(roomId);
+            return {};
+        }
+        if (room->owner == chatId) {
+            room->owner = members.front();
+        }
+        return members;
+    }
+
+    size_t size() const {
+        return rooms.size();
+    }
+
+private:
+    FlatTable<Room> rooms;
+    FlatTable<int64_t> memberRoom;
+    int64_t nextRoomId = 1000;
+};
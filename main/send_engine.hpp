@@ -0,0 +1,439 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <curl/curl.h>
+#include "curl_pool.hpp"
+#include "reactor.hpp"
+#if defined(BOT_TLS_METRICS)
+#include <openssl/ssl.h>
+#endif
+
+struct SendResult {
+    CURLcode curl_code = CURLE_OK;
+    long http_status = 0;
+    std::string body;
+
+    bool ok() const {
+        return curl_code == CURLE_OK && http_status == 200;
+    }
+};
+
+using SendCallback = std::function<void(const SendResult&)>;
+
+// Connection setup counters. A lookup served from the DNS cache finishes in
+// microseconds, so only lookups slower than lookupThresholdUs count as
+// resolver round trips. Telling full from resumed TLS handshakes needs the
+// OpenSSL session pointer: build with -DBOT_TLS_METRICS (and -lssl) to
+// fill tlsResumed. bytesReceived counts response bodies as they came off
+// the wire (compressed), bytesDecoded what was handed to the caller.
+struct TransportStats {
+    size_t transfers = 0;
+    size_t newConnections = 0;
+    size_t dnsLookups = 0;
+    uint64_t lookupMicros = 0;
+    size_t tlsHandshakes = 0;
+    size_t tlsResumed = 0;
+    size_t http2Transfers = 0;
+    uint64_t bytesReceived = 0;
+    uint64_t bytesDecoded = 0;
+    long lookupThresholdUs = 1000;
+};
+
+// Non-blocking outbound transport: requests are queued, driven concurrently
+// on a curl multi handle and reported back through their callbacks. It
+// either drives itself via perform()/poll(), or, once attach()ed to a
+// Reactor, runs on curl's multi-socket API from the reactor's events.
+class SendEngine {
+public:
+    size_t maxConcurrent = 32;
+    size_t maxSpare = 64;
+    bool compressDownloads = true;
+    TransportStats stats;
+
+    explicit SendEngine(CurlPool& curlPool) : pool(curlPool) {
+        multi = curl_multi_init();
+        setMultiplex(true);
+    }
+
+    ~SendEngine() {
+        shutdown();
+    }
+
+    SendEngine(const SendEngine&) = delete;
+    SendEngine& operator=(const SendEngine&) = delete;
+
+    // Posts sharing a non-zero lane (a chat id) go out one at a time, each
+    // starting once the previous one has finished, so the server sees them
+    // in the order they were posted. Other lanes still run in parallel.
+    void post(std::string url, std::string body, const char* caller, SendCallback done = nullptr, long timeoutMs = 0, int64_t lane = 0) {
+        std::unique_ptr<Transfer> transfer = obtain();
+        transfer->url = std::move(url);
+        transfer->body = std::move(body);
+        transfer->post = true;
+        transfer->caller = caller;
+        transfer->done = std::move(done);
+        transfer->timeoutMs = timeoutMs;
+        transfer->lane = lane;
+        if (lane != 0) {
+            ++lanes[lane].pending;
+        }
+        queued.push_back(std::move(transfer));
+    }
+
+    // A non-null sink receives the response body instead of SendResult::body,
+    // letting callers reuse their own buffer. With compressDownloads the
+    // body is requested compressed and decoded on the fly as it arrives.
+    void get(std::string url, const char* caller, SendCallback done = nullptr, long timeoutMs = 0, std::string* sink = NULL) {
+        std::unique_ptr<Transfer> transfer = obtain();
+        transfer->url = std::move(url);
+        transfer->caller = caller;
+        transfer->done = std::move(done);
+        transfer->timeoutMs = timeoutMs;
+        transfer->sink = sink;
+        queued.push_back(std::move(transfer));
+    }
+
+    // With multiplexing on, HTTPS transfers negotiate HTTP/2 and concurrent
+    // sends become streams on at most maxHostConnections connections per
+    // host (new transfers wait for an existing connection instead of
+    // opening their own). Servers without HTTP/2, or enabled = false, get
+    // plain HTTP/1.1 with one connection per concurrent transfer. Call it
+    // before traffic starts; idle pooled handles keep their old setting.
+    void setMultiplex(bool enabled, long maxStreams = 100, long maxHostConnections = 4) {
+        pool.http2 = enabled;
+        if (!multi) return;
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, enabled ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+        curl_multi_setopt(multi, CURLMOPT_MAX_CONCURRENT_STREAMS, maxStreams);
+        curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, enabled ? maxHostConnections : 0L);
+    }
+
+    // Hands socket and timeout management to reactor; from then on
+    // poll() runs reactor rounds and perform() only starts queued requests.
+    void attach(Reactor& eventLoop) {
+        if (!multi) return;
+        reactor = &eventLoop;
+        curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socketCallback);
+        curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+        curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timerCallback);
+        curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+    }
+
+    void perform() {
+        if (!multi) return;
+        startQueued();
+        if (reactor) return;
+        int running = 0;
+        curl_multi_perform(multi, &running);
+        reap();
+        startQueued();
+    }
+
+    void poll(int timeoutMs, int extraFd = -1) {
+        if (!multi) return;
+        if (reactor) {
+            reactor->runOnce(timeoutMs);
+            return;
+        }
+        perform();
+        struct curl_waitfd waitfd = { extraFd, CURL_WAIT_POLLIN, 0 };
+        curl_multi_poll(multi, extraFd >= 0 ? &waitfd : NULL, extraFd >= 0 ? 1 : 0, timeoutMs, NULL);
+        perform();
+    }
+
+    void flush() {
+        while (busy()) {
+            poll(100);
+        }
+    }
+
+    bool busy() const {
+        return !active.empty() || !queued.empty() || parked > 0;
+    }
+
+    size_t pending() const {
+        return active.size() + queued.size() + parked;
+    }
+
+    // True while a post on lane is queued or in flight.
+    bool sending(int64_t lane) const {
+        return lanes.count(lane) > 0;
+    }
+
+    void shutdown() {
+        if (!multi) return;
+        for (auto& [curl, transfer] : active) {
+            curl_multi_remove_handle(multi, curl);
+            curl_easy_cleanup(curl);
+        }
+        active.clear();
+        queued.clear();
+        lanes.clear();
+        parked = 0;
+        curl_multi_cleanup(multi);
+        multi = NULL;
+        if (reactor && curlTimer != 0) {
+            reactor->timers.cancel(curlTimer);
+            curlTimer = 0;
+        }
+    }
+
+private:
+    struct Transfer {
+        std::string url;
+        std::string body;
+        bool post = false;
+        long timeoutMs = 0;
+        std::string* sink = NULL;
+        uint64_t decodedBytes = 0;
+        CURL* curl = NULL;
+        bool tlsResumed = false;
+        const char* caller = "";
+        int64_t lane = 0;
+        SendCallback done;
+        SendResult result;
+    };
+
+    // Posts of one lane that are queued or running; `waiting` holds the
+    // ones that reached the front of the queue while another was running.
+    struct Lane {
+        size_t pending = 0;
+        bool running = false;
+        std::deque<std::unique_ptr<Transfer>> waiting;
+    };
+
+    CurlPool& pool;
+    CURLM* multi = NULL;
+    std::deque<std::unique_ptr<Transfer>> queued;
+    std::unordered_map<CURL*, std::unique_ptr<Transfer>> active;
+    std::vector<std::unique_ptr<Transfer>> spare;
+    std::unordered_map<int64_t, Lane> lanes;
+    size_t parked = 0;
+    Reactor* reactor = NULL;
+    uint64_t curlTimer = 0;
+
+    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, Transfer* transfer) {
+        size_t totalSize = size * nmemb;
+        (transfer->sink ? transfer->sink : &transfer->result.body)->append((char*)contents, totalSize);
+        transfer->decodedBytes += totalSize;
+        return totalSize;
+    }
+
+    // Finished transfers are recycled so the response buffer keeps its
+    // capacity; a typical Bot API reply then needs no allocation at all.
+    std::unique_ptr<Transfer> obtain() {
+        if (spare.empty()) return std::make_unique<Transfer>();
+        std::unique_ptr<Transfer> transfer = std::move(spare.back());
+        spare.pop_back();
+        return transfer;
+    }
+
+    void recycle(std::unique_ptr<Transfer> transfer) {
+        if (spare.size() >= maxSpare) return;
+        transfer->body.clear();
+        transfer->post = false;
+        transfer->timeoutMs = 0;
+        transfer->sink = NULL;
+        transfer->decodedBytes = 0;
+        transfer->curl = NULL;
+        transfer->tlsResumed = false;
+        transfer->caller = "";
+        transfer->lane = 0;
+        transfer->done = nullptr;
+        transfer->result.curl_code = CURLE_OK;
+        transfer->result.http_status = 0;
+        transfer->result.body.clear();
+        spare.push_back(std::move(transfer));
+    }
+
+    void startQueued() {
+        while (!queued.empty() && active.size() < maxConcurrent) {
+            Lane* lane = queued.front()->lane != 0 ? &lanes[queued.front()->lane] : nullptr;
+            if (lane && lane->running) {
+                lane->waiting.push_back(std::move(queued.front()));
+                queued.pop_front();
+                ++parked;
+                continue;
+            }
+            CURL* curl = pool.acquire();
+            if (!curl) return;
+            std::unique_ptr<Transfer> transfer = std::move(queued.front());
+            queued.pop_front();
+            if (lane) {
+                lane->running = true;
+            }
+            curl_easy_setopt(curl, CURLOPT_URL, transfer->url.c_str());
+            if (transfer->post) {
+                curl_easy_setopt(curl, CURLOPT_HTTPHEADER, pool.headers());
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDS, transfer->body.c_str());
+                curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)transfer->body.size());
+            }
+            if (transfer->timeoutMs > 0) {
+                curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, transfer->timeoutMs);
+            }
+            curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(curl, CURLOPT_WRITEDATA, transfer.get());
+            if (!transfer->post && compressDownloads) {
+                // "" offers every encoding this libcurl was built with.
+                curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+            }
+            transfer->curl = curl;
+#if defined(BOT_TLS_METRICS)
+            curl_easy_setopt(curl, CURLOPT_PREREQFUNCTION, prereqCallback);
+            curl_easy_setopt(curl, CURLOPT_PREREQDATA, transfer.get());
+#endif
+            if (curl_multi_add_handle(multi, curl) != CURLM_OK) {
+                pool.release(curl);
+                std::cerr << transfer->caller << " Curl error: could not start transfer" << std::endl;
+                transfer->result.curl_code = CURLE_FAILED_INIT;
+                finishLane(transfer->lane);
+                if (transfer->done) {
+                    transfer->done(transfer->result);
+                }
+                recycle(std::move(transfer));
+                continue;
+            }
+            active.emplace(curl, std::move(transfer));
+        }
+    }
+
+    static int socketCallback(CURL*, curl_socket_t socket, int what, void* userp, void*) {
+        SendEngine* engine = static_cast<SendEngine*>(userp);
+        Reactor& loop = *engine->reactor;
+        if (what == CURL_POLL_REMOVE) {
+            loop.unwatch(socket);
+            return 0;
+        }
+        uint32_t events = 0;
+        if (what & CURL_POLL_IN) events |= EPOLLIN;
+        if (what & CURL_POLL_OUT) events |= EPOLLOUT;
+        if (loop.watching(socket)) {
+            loop.modify(socket, events);
+        } else {
+            loop.watch(socket, events, [engine, socket](uint32_t ready) {
+                int flags = 0;
+                if (ready & EPOLLIN) flags |= CURL_CSELECT_IN;
+                if (ready & EPOLLOUT) flags |= CURL_CSELECT_OUT;
+                if (ready & (EPOLLERR | EPOLLHUP)) flags |= CURL_CSELECT_ERR;
+                engine->socketAction(socket, flags);
+            });
+        }
+        return 0;
+    }
+
+    // curl keeps a single timeout; each call replaces the previous one.
+    static int timerCallback(CURLM*, long timeoutMs, void* userp) {
+        SendEngine* engine = static_cast<SendEngine*>(userp);
+        Reactor& loop = *engine->reactor;
+        if (engine->curlTimer != 0) {
+            loop.timers.cancel(engine->curlTimer);
+            engine->curlTimer = 0;
+        }
+        if (timeoutMs >= 0) {
+            engine->curlTimer = loop.timers.schedule(std::chrono::milliseconds(timeoutMs), [engine]() {
+                engine->curlTimer = 0;
+                engine->socketAction(CURL_SOCKET_TIMEOUT, 0);
+            });
+        }
+        return 0;
+    }
+
+    void socketAction(curl_socket_t socket, int flags) {
+        if (!multi) return;
+        int running = 0;
+        curl_multi_socket_action(multi, socket, flags, &running);
+        reap();
+        startQueued();
+    }
+
+    void recordConnection(CURL* curl, const Transfer& transfer) {
+        ++stats.transfers;
+        curl_off_t received = 0;
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+        stats.bytesReceived += (uint64_t)received;
+        stats.bytesDecoded += transfer.decodedBytes;
+        long version = 0;
+        curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+        if (version == CURL_HTTP_VERSION_2_0) {
+            ++stats.http2Transfers;
+        }
+        long connects = 0;
+        curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+        if (connects <= 0) return;
+        ++stats.newConnections;
+        curl_off_t lookup = 0;
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &lookup);
+        stats.lookupMicros += (uint64_t)lookup;
+        if (lookup >= stats.lookupThresholdUs) {
+            ++stats.dnsLookups;
+        }
+        if (transfer.url.compare(0, 8, "https://") == 0) {
+            ++stats.tlsHandshakes;
+            if (transfer.tlsResumed) {
+                ++stats.tlsResumed;
+            }
+        }
+    }
+
+#if defined(BOT_TLS_METRICS)
+    // Runs once the connection is up, while the SSL object is still attached.
+    static int prereqCallback(void* clientp, char*, char*, int, int) {
+        Transfer* transfer = static_cast<Transfer*>(clientp);
+        struct curl_tlssessioninfo* info = NULL;
+        if (curl_easy_getinfo(transfer->curl, CURLINFO_TLS_SSL_PTR, &info) == CURLE_OK && info
+            && info->backend == CURLSSLBACKEND_OPENSSL && info->internals) {
+            transfer->tlsResumed = SSL_session_reused((SSL*)info->internals) == 1;
+        }
+        return CURL_PREREQFUNC_OK;
+    }
+#endif
+
+    void reap() {
+        int remaining = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &remaining)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL* curl = msg->easy_handle;
+            auto it = active.find(curl);
+            if (it == active.end()) continue;
+            std::unique_ptr<Transfer> transfer = std::move(it->second);
+            active.erase(it);
+            transfer->result.curl_code = msg->data.result;
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &transfer->result.http_status);
+            recordConnection(curl, *transfer);
+            curl_multi_remove_handle(multi, curl);
+            pool.release(curl);
+            if (transfer->result.curl_code != CURLE_OK) {
+                std::cerr << transfer->caller << " Curl error: " << curl_easy_strerror(transfer->result.curl_code) << std::endl;
+            }
+            finishLane(transfer->lane);
+            if (transfer->done) {
+                transfer->done(transfer->result);
+            }
+            recycle(std::move(transfer));
+        }
+    }
+
+    // The lane's waiting posts go back to the front of the queue, still in
+    // order; the first of them to start holds the lane again.
+    void finishLane(int64_t id) {
+        if (id == 0) return;
+        auto it = lanes.find(id);
+        if (it == lanes.end()) return;
+        Lane& lane = it->second;
+        lane.running = false;
+        parked -= lane.waiting.size();
+        while (!lane.waiting.empty()) {
+            queued.push_front(std::move(lane.waiting.back()));
+            lane.waiting.pop_back();
+        }
+        if (--lane.pending == 0) {
+            lanes.erase(it);
+        }
+    }
+};
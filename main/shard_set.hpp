@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "reactor.hpp"
+#include "ring_buffer.hpp"
+
+// Thread-per-core runtime: each shard is a thread running its own Reactor,
+// and the only way in is its mailbox (an MPMC ring drained from the loop
+// through an eventfd). Whatever a shard owns is only ever touched by its own
+// thread, so it needs no locks; other threads send it messages instead.
+class ShardSet {
+public:
+    using Message = std::function<void()>;
+    using Init = std::function<void(size_t index, Reactor& loop)>;
+
+    static constexpr size_t NONE = SIZE_MAX;
+
+    // Messages run per wakeup before the loop gets back to its sockets.
+    size_t drainBatch = 256;
+
+    explicit ShardSet(size_t count, size_t mailboxCapacity = 4096) {
+        for (size_t i = 0; i < std::max<size_t>(1, count); ++i) {
+            shards.push_back(std::make_unique<Shard>(mailboxCapacity));
+            Shard& shard = *shards.back();
+            shard.wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (shard.wakeFd < 0) {
+                std::cerr << "ShardSet eventfd error: " << std::strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    ~ShardSet() {
+        stop();
+        for (auto& shard : shards) {
+            if (shard->wakeFd >= 0) ::close(shard->wakeFd);
+        }
+    }
+
+    ShardSet(const ShardSet&) = delete;
+    ShardSet& operator=(const ShardSet&) = delete;
+
+    // Starts every shard: init runs first on the shard's own thread (set up
+    // what that shard owns, attach it to loop), then the loop runs.
+    void start(Init init) {
+        for (size_t i = 0; i < shards.size(); ++i) {
+            Shard* shard = shards[i].get();
+            shard->thread = std::thread([this, shard, i, init]() {
+                currentShard = i;
+                shard->loop.watch(shard->wakeFd, EPOLLIN, [this, shard](uint32_t) {
+                    drain(*shard);
+                });
+                init(i, shard->loop);
+                shard->loop.run();
+                shard->loop.unwatch(shard->wakeFd);
+                currentShard = NONE;
+            });
+        }
+    }
+
+    // Never blocks: a full mailbox spills into an overflow list. Shards use
+    // this for each other, so two busy shards cannot wait on one another.
+    void post(size_t index, Message message) {
+        Shard& shard = *shards[index];
+        if (shard.overflowCount > 0 || !shard.mailbox.tryPush(message)) {
+            std::lock_guard<std::mutex> lock(shard.overflowMutex);
+            shard.overflow.push_back(std::move(message));
+            shard.overflowCount = shard.overflow.size();
+        }
+        signal(shard);
+    }
+
+    // Blocks while the mailbox is full, or while messages spilled by post()
+    // are still waiting (they go first); for threads outside the shards
+    // (the update fetcher), so a slow shard pushes back on its input.
+    void send(size_t index, Message message) {
+        Shard& shard = *shards[index];
+        if (shard.overflowCount > 0 || !shard.mailbox.tryPush(message)) {
+            shard.space.wait([&]() {
+                return (shard.overflowCount == 0 && shard.mailbox.tryPush(message)) || stopping;
+            });
+        }
+        signal(shard);
+    }
+
+    // Index of the shard running the calling thread, or NONE.
+    static size_t current() {
+        return currentShard;
+    }
+
+    size_t size() const {
+        return shards.size();
+    }
+
+    size_t depth(size_t index) const {
+        return shards[index]->mailbox.size() + shards[index]->overflowCount.load();
+    }
+
+    void stop() {
+        stopping = true;
+        for (size_t i = 0; i < shards.size(); ++i) {
+            if (!shards[i]->thread.joinable()) continue;
+            Reactor* loop = &shards[i]->loop;
+            post(i, [loop]() {
+                loop->stop();
+            });
+            shards[i]->space.notify();
+        }
+        for (auto& shard : shards) {
+            if (shard->thread.joinable()) shard->thread.join();
+        }
+    }
+
+private:
+    struct Shard {
+        Reactor loop;
+        MpmcRing<Message> mailbox;
+        std::mutex overflowMutex;
+        std::vector<Message> overflow;
+        std::atomic<size_t> overflowCount{ 0 };
+        // Set while a wakeup is pending, so a burst of messages costs one
+        // eventfd write instead of one per message.
+        std::atomic<bool> signalled{ false };
+        Parker space;
+        int wakeFd = -1;
+        std::thread thread;
+
+        explicit Shard(size_t capacity) : mailbox(capacity) {}
+    };
+
+    inline static thread_local size_t currentShard = NONE;
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<bool> stopping{ false };
+
+    void signal(Shard& shard) {
+        if (shard.signalled.exchange(true)) return;
+        uint64_t one = 1;
+        if (::write(shard.wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            std::cerr << "ShardSet wake error: " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    void drain(Shard& shard) {
+        uint64_t count;
+        while (::read(shard.wakeFd, &count, sizeof(count)) > 0) {}
+        shard.signalled = false;
+        Message message;
+        size_t ran = 0;
+        while (ran < drainBatch && shard.mailbox.tryPop(message)) {
+            message();
+            message = nullptr;
+            ++ran;
+        }
+        if (ran > 0) shard.space.notify();
+        // Overflow only once the ring is empty, so spilled messages still
+        // run after the ones their sender queued earlier. Nothing enters
+        // the ring while overflow is non-empty, so it does empty and no
+        // later message gets ahead of a spilled one.
+        if (ran < drainBatch && shard.overflowCount > 0) {
+            std::vector<Message> spilled;
+            {
+                std::lock_guard<std::mutex> lock(shard.overflowMutex);
+                spilled.swap(shard.overflow);
+                shard.overflowCount = 0;
+            }
+            shard.space.notify();
+            for (Message& pending : spilled) {
+                pending();
+            }
+        }
+        if (shard.mailbox.size() > 0 || shard.overflowCount > 0) {
+            shard.signalled = false;
+            signal(shard);
+        }
+    }
+};
@@ -0,0 +1,193 @@
+#pragma once
+
+// Coroutine support for handler code. The bot is built as C++20.
+#if !defined(__cpp_impl_coroutine)
+#error "task.hpp needs C++20 coroutines; build with -std=c++20"
+#endif
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <utility>
+
+template <typename T>
+class Task;
+
+namespace task_detail {
+
+// At the end of a Task, hand control to whoever awaited it (symmetric
+// transfer); a detached Task destroys its own frame instead.
+struct FinalAwaiter {
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        if (handle.promise().detached) {
+            handle.destroy();
+        }
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    bool detached = false;
+
+    std::suspend_always initial_suspend() const noexcept {
+        return {};
+    }
+
+    FinalAwaiter final_suspend() const noexcept {
+        return {};
+    }
+
+    void unhandled_exception() const noexcept {
+        std::terminate();
+    }
+};
+
+}
+
+// Lazily started coroutine: it runs when awaited (or detach()ed) and
+// resumes its awaiter when it finishes. After each co_await it carries on
+// on whichever thread delivered the result: the reactor in single-threaded
+// mode, the handler thread or the chat's worker in pipeline mode, the
+// sending shard in shard mode.
+template <typename T = void>
+class Task {
+public:
+    struct promise_type : task_detail::PromiseBase {
+        T value{};
+
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_value(T result) {
+            value = std::move(result);
+        }
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() {
+        return std::move(handle.promise().value);
+    }
+
+    // Starts the coroutine without an awaiter; it frees itself when done.
+    void detach() {
+        std::coroutine_handle<promise_type> started = std::exchange(handle, {});
+        started.promise().detached = true;
+        started.resume();
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+};
+
+template <>
+class Task<void> {
+public:
+    struct promise_type : task_detail::PromiseBase {
+        Task get_return_object() {
+            return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        void return_void() const noexcept {}
+    };
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    void await_resume() const noexcept {}
+
+    void detach() {
+        std::coroutine_handle<promise_type> started = std::exchange(handle, {});
+        started.promise().detached = true;
+        started.resume();
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+    explicit Task(std::coroutine_handle<promise_type> coroutine) : handle(coroutine) {}
+};
+
+// Adapts a callback-style operation to co_await: start runs when the
+// coroutine suspends and the callback it is given resumes the coroutine
+// with the result. The callback may fire before start returns (a send that
+// fails to start completes at once); the coroutine then does not suspend
+// at all, since resuming it there could finish it and free this awaitable
+// while start is still running.
+template <typename T>
+class CallbackAwaitable {
+public:
+    using Callback = std::function<void(const T&)>;
+    using Starter = std::function<void(Callback)>;
+
+    explicit CallbackAwaitable(Starter starter) : start(std::move(starter)) {}
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    // Whichever of start returning and the callback firing comes second
+    // continues the coroutine.
+    bool await_suspend(std::coroutine_handle<> handle) {
+        start([this, handle](const T& value) {
+            result = value;
+            if (settled.exchange(true, std::memory_order_acq_rel)) {
+                handle.resume();
+            }
+        });
+        return !settled.exchange(true, std::memory_order_acq_rel);
+    }
+
+    T await_resume() {
+        return std::move(result);
+    }
+
+private:
+    Starter start;
+    T result{};
+    std::atomic<bool> settled{ false };
+};
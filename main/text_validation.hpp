@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// UTF-8 helpers for user-supplied text. The SSE2 paths handle 16 bytes per
+// step (ASCII runs for validation, two-byte U+0600..U+06FF runs for Persian
+// names); everything else goes through the scalar decoder.
+inline bool isUtf8Continuation(unsigned char c) {
+    return (c & 0xC0) == 0x80;
+}
+
+// Decodes one strict UTF-8 sequence at s[i]; returns its length or 0 when
+// the bytes are malformed, overlong, a surrogate or above U+10FFFF.
+inline size_t decodeUtf8(std::string_view s, size_t i, uint32_t& codepoint) {
+    const unsigned char* p = (const unsigned char*)s.data() + i;
+    size_t left = s.size() - i;
+    unsigned char c = p[0];
+    if (c < 0x80) {
+        codepoint = c;
+        return 1;
+    }
+    if (c >= 0xC2 && c <= 0xDF) {
+        if (left < 2 || !isUtf8Continuation(p[1])) return 0;
+        codepoint = ((uint32_t)(c & 0x1F) << 6) | (p[1] & 0x3F);
+        return 2;
+    }
+    if (c >= 0xE0 && c <= 0xEF) {
+        if (left < 3 || !isUtf8Continuation(p[1]) || !isUtf8Continuation(p[2])) return 0;
+        codepoint = ((uint32_t)(c & 0x0F) << 12) | ((uint32_t)(p[1] & 0x3F) << 6) | (p[2] & 0x3F);
+        if (codepoint < 0x800 || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) return 0;
+        return 3;
+    }
+    if (c >= 0xF0 && c <= 0xF4) {
+        if (left < 4 || !isUtf8Continuation(p[1]) || !isUtf8Continuation(p[2]) || !isUtf8Continuation(p[3])) return 0;
+        codepoint = ((uint32_t)(c & 0x07) << 18) | ((uint32_t)(p[1] & 0x3F) << 12) | ((uint32_t)(p[2] & 0x3F) << 6) | (p[3] & 0x3F);
+        if (codepoint < 0x10000 || codepoint > 0x10FFFF) return 0;
+        return 4;
+    }
+    return 0;
+}
+
+inline bool isValidUtf8(std::string_view s) {
+    size_t i = 0;
+    while (i < s.size()) {
+#if defined(__SSE2__)
+        if (s.size() - i >= 16) {
+            __m128i block = _mm_loadu_si128((const __m128i*)(s.data() + i));
+            if (_mm_movemask_epi8(block) == 0) {
+                i += 16;
+                continue;
+            }
+        }
+#endif
+        uint32_t codepoint;
+        size_t length = decodeUtf8(s, i, codepoint);
+        if (length == 0) return false;
+        i += length;
+    }
+    return true;
+}
+
+// Number of code points, assuming s is valid UTF-8.
+inline size_t countCodepoints(std::string_view s) {
+    size_t count = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i lastContinuation = _mm_set1_epi8((char)0xBF);
+    for (; i + 16 <= s.size(); i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(s.data() + i));
+        // Signed compare: continuation bytes 0x80..0xBF are the only values <= (int8_t)0xBF.
+        count += (size_t)__builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(block, lastContinuation)));
+    }
+#endif
+    for (; i < s.size(); ++i) {
+        if (!isUtf8Continuation((unsigned char)s[i])) ++count;
+    }
+    return count;
+}
+
+inline bool isPersianLetter(uint32_t codepoint) {
+    return codepoint >= 0x0600 && codepoint <= 0x06FF;
+}
+
+// True when s consists only of U+0600..U+06FF letters, optionally joined by
+// single ZWNJs (never leading, trailing or doubled), and holds between
+// minLetters and maxLetters letters. ZWNJ does not count as a letter.
+inline bool isPersianName(std::string_view s, size_t minLetters, size_t maxLetters) {
+    const uint32_t zwnj = 0x200C;
+    if (s.size() < minLetters * 2 || s.size() > maxLetters * 2 + (maxLetters - 1) * 3) return false;
+
+    size_t letters = 0;
+    bool lastWasJoiner = false;
+    size_t i = 0;
+    while (i < s.size()) {
+#if defined(__SSE2__)
+        if (s.size() - i >= 16) {
+            // Eight two-byte sequences with lead 0xD8..0xDB cover exactly U+0600..U+06FF.
+            const __m128i laneMask = _mm_set1_epi16((short)0xC0FC);
+            const __m128i expected = _mm_set1_epi16((short)0x80D8);
+            __m128i block = _mm_loadu_si128((const __m128i*)(s.data() + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(block, laneMask), expected)) == 0xFFFF) {
+                letters += 8;
+                lastWasJoiner = false;
+                i += 16;
+                continue;
+            }
+        }
+#endif
+        uint32_t codepoint;
+        size_t length = decodeUtf8(s, i, codepoint);
+        if (length == 0) return false;
+        if (isPersianLetter(codepoint)) {
+            ++letters;
+            lastWasJoiner = false;
+        } else if (codepoint == zwnj && letters > 0 && !lastWasJoiner) {
+            lastWasJoiner = true;
+        } else {
+            return false;
+        }
+        i += length;
+    }
+    return !lastWasJoiner && letters >= minLetters && letters <= maxLetters;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// One-shot timers kept in a binary min-heap. The owner calls runDue() from
+// its loop and bounds its wait with msUntilNext().
+class TimerQueue {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+
+    // Returns an id for cancel(); ids are never 0.
+    uint64_t schedule(std::chrono::milliseconds delay, Callback fn) {
+        uint64_t id = ++nextSeq;
+        heap.push_back({ Clock::now() + delay, id, std::move(fn) });
+        std::push_heap(heap.begin(), heap.end(), later);
+        return id;
+    }
+
+    bool cancel(uint64_t id) {
+        for (size_t i = 0; i < heap.size(); ++i) {
+            if (heap[i].seq != id) continue;
+            heap[i] = std::move(heap.back());
+            heap.pop_back();
+            std::make_heap(heap.begin(), heap.end(), later);
+            return true;
+        }
+        return false;
+    }
+
+    // Runs every timer whose deadline has passed; timers scheduled by the
+    // callbacks wait for the next call.
+    size_t runDue() {
+        Clock::time_point now = Clock::now();
+        std::vector<Callback> due;
+        while (!heap.empty() && heap.front().deadline <= now) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            due.push_back(std::move(heap.back().fn));
+            heap.pop_back();
+        }
+        for (Callback& fn : due) {
+            fn();
+        }
+        return due.size();
+    }
+
+    // Milliseconds until the earliest deadline (0 when overdue), -1 when empty.
+    int msUntilNext() const {
+        if (heap.empty()) return -1;
+        auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(heap.front().deadline - Clock::now()).count();
+        return wait <= 0 ? 0 : (int)wait + 1;
+    }
+
+    size_t size() const {
+        return heap.size();
+    }
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+private:
+    struct Timer {
+        Clock::time_point deadline;
+        uint64_t seq;
+        Callback fn;
+    };
+
+    std::vector<Timer> heap;
+    uint64_t nextSeq = 0;
+
+    static bool later(const Timer& a, const Timer& b) {
+        return a.deadline != b.deadline ? a.deadline > b.deadline : a.seq > b.seq;
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for short-lived strings. Chunks are kept across reset()
+// so a steady stream of batches stops touching the heap after warm-up.
+class Arena {
+public:
+    explicit Arena(size_t defaultChunkSize = 64 * 1024) : chunkSize(defaultChunkSize) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&&) = default;
+    Arena& operator=(Arena&&) = default;
+
+    char* allocate(size_t size) {
+        while (current < chunks.size()) {
+            Chunk& chunk = chunks[current];
+            if (used + size <= chunk.size) {
+                char* out = chunk.data.get() + used;
+                used += size;
+                bytesUsed += size;
+                return out;
+            }
+            ++current;
+            used = 0;
+        }
+        size_t chunkBytes = std::max(chunkSize, size);
+        chunks.push_back({ std::unique_ptr<char[]>(new char[chunkBytes]), chunkBytes });
+        used = size;
+        bytesUsed += size;
+        return chunks.back().data.get();
+    }
+
+    std::string_view copy(std::string_view text) {
+        if (text.empty()) return std::string_view();
+        char* out = allocate(text.size());
+        std::memcpy(out, text.data(), text.size());
+        return std::string_view(out, text.size());
+    }
+
+    void reset() {
+        chunks.erase(std::remove_if(chunks.begin(), chunks.end(), [this](const Chunk& chunk) {
+            return chunk.size > chunkSize;
+        }), chunks.end());
+        current = 0;
+        used = 0;
+        bytesUsed = 0;
+    }
+
+    size_t size() const {
+        return bytesUsed;
+    }
+
+private:
+    struct Chunk {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+
+    size_t chunkSize;
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+    size_t used = 0;
+    size_t bytesUsed = 0;
+};
+
+// Storage behind one round of received updates: the raw getUpdates response
+// and the arena that the std::string_view fields of Bot::Message and
+// Bot::Callback point into. Everything is released together by clear().
+class UpdateBatch {
+public:
+    std::string raw;
+    Arena arena;
+
+    std::string_view store(std::string_view text) {
+        return arena.copy(text);
+    }
+
+    void clear() {
+        raw.clear();
+        arena.reset();
+    }
+};
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// The handful of update fields the bot acts on. Strings keep their capacity
+// between updates, so decoding a batch does not allocate per field.
+struct UpdateFields {
+    int64_t update_id = 0;
+    bool has_text = false;
+    bool has_message_chat = false;
+    int64_t message_chat_id = 0;
+    std::string text;
+    bool has_callback = false;
+    bool has_callback_chat = false;
+    int64_t callback_chat_id = 0;
+    int64_t callback_message_id = 0;
+    std::string callback_id;
+    std::string callback_data;
+
+    void reset() {
+        update_id = 0;
+        has_text = false;
+        has_message_chat = false;
+        message_chat_id = 0;
+        text.clear();
+        has_callback = false;
+        has_callback_chat = false;
+        callback_chat_id = 0;
+        callback_message_id = 0;
+        callback_id.clear();
+        callback_data.clear();
+    }
+};
+
+// SAX handler that decodes getUpdates responses ({"ok":..,"result":[...]})
+// or a single webhook update straight into UpdateFields, handing each
+// finished update to sink. Everything else in the payload is skipped
+// without being materialised.
+template <typename Sink>
+class UpdateSaxHandler final : public nlohmann::json_sax<nlohmann::json> {
+public:
+    enum class Mode {
+        Envelope,
+        SingleUpdate
+    };
+
+    bool ok = false;
+    size_t count = 0;
+    int64_t last_update_id = 0;
+    std::string description;
+    std::string error;
+
+    UpdateSaxHandler(Mode parseMode, Sink& updateSink) : mode(parseMode), sink(updateSink) {
+        frames.reserve(16);
+    }
+
+    bool null() override {
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool boolean(bool val) override {
+        if (mode == Mode::Envelope && frames.size() == 1 && currentKey == Key::Ok) {
+            ok = val;
+        }
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool number_integer(number_integer_t val) override {
+        onInteger((int64_t)val);
+        return true;
+    }
+
+    bool number_unsigned(number_unsigned_t val) override {
+        onInteger((int64_t)val);
+        return true;
+    }
+
+    bool number_float(number_float_t, const string_t&) override {
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool string(string_t& val) override {
+        if (mode == Mode::Envelope && frames.size() == 1 && currentKey == Key::Description) {
+            description = val;
+        } else if (inUpdate) {
+            size_t rel = frames.size() - updateDepth;
+            if (rel == 1 && frames.back() == Key::Message && currentKey == Key::Text) {
+                fields.text.assign(val);
+                fields.has_text = true;
+            } else if (rel == 1 && frames.back() == Key::CallbackQuery) {
+                if (currentKey == Key::Id) {
+                    fields.callback_id.assign(val);
+                    fields.has_callback = true;
+                } else if (currentKey == Key::Data) {
+                    fields.callback_data.assign(val);
+                }
+            }
+        }
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool binary(binary_t&) override {
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool start_object(std::size_t) override {
+        bool startsUpdate = mode == Mode::SingleUpdate
+            ? frames.empty()
+            : frames.size() == 2 && frames[1] == Key::Result;
+        frames.push_back(currentKey);
+        currentKey = Key::Other;
+        if (startsUpdate) {
+            inUpdate = true;
+            updateDepth = frames.size();
+            fields.reset();
+        }
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        currentKey = classify(val);
+        return true;
+    }
+
+    bool end_object() override {
+        if (inUpdate && frames.size() == updateDepth) {
+            inUpdate = false;
+            ++count;
+            last_update_id = fields.update_id;
+            sink(fields);
+        }
+        frames.pop_back();
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        frames.push_back(currentKey);
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool end_array() override {
+        frames.pop_back();
+        currentKey = Key::Other;
+        return true;
+    }
+
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override {
+        error = ex.what();
+        return false;
+    }
+
+private:
+    enum class Key : uint8_t {
+        Other,
+        Ok,
+        Description,
+        Result,
+        UpdateId,
+        Message,
+        CallbackQuery,
+        Chat,
+        Id,
+        Text,
+        Data,
+        MessageId
+    };
+
+    Mode mode;
+    Sink& sink;
+    std::vector<Key> frames;
+    Key currentKey = Key::Other;
+    bool inUpdate = false;
+    size_t updateDepth = 0;
+    UpdateFields fields;
+
+    static Key classify(const std::string& name) {
+        switch (name.size()) {
+            case 2:
+                if (name == "ok") return Key::Ok;
+                if (name == "id") return Key::Id;
+                break;
+            case 4:
+                if (name == "chat") return Key::Chat;
+                if (name == "text") return Key::Text;
+                if (name == "data") return Key::Data;
+                break;
+            case 6:
+                if (name == "result") return Key::Result;
+                break;
+            case 7:
+                if (name == "message") return Key::Message;
+                break;
+            case 9:
+                if (name == "update_id") return Key::UpdateId;
+                break;
+            case 10:
+                if (name == "message_id") return Key::MessageId;
+                break;
+            case 11:
+                if (name == "description") return Key::Description;
+                break;
+            case 14:
+                if (name == "callback_query") return Key::CallbackQuery;
+                break;
+        }
+        return Key::Other;
+    }
+
+    void onInteger(int64_t val) {
+        if (inUpdate) {
+            size_t rel = frames.size() - updateDepth;
+            const Key* path = frames.data() + updateDepth;
+            if (rel == 0 && currentKey == Key::UpdateId) {
+                fields.update_id = val;
+            } else if (rel == 2 && path[0] == Key::Message && path[1] == Key::Chat && currentKey == Key::Id) {
+                fields.message_chat_id = val;
+                fields.has_message_chat = true;
+            } else if (rel == 2 && path[0] == Key::CallbackQuery && path[1] == Key::Message && currentKey == Key::MessageId) {
+                fields.callback_message_id = val;
+            } else if (rel == 3 && path[0] == Key::CallbackQuery && path[1] == Key::Message && path[2] == Key::Chat && currentKey == Key::Id) {
+                fields.callback_chat_id = val;
+                fields.has_callback_chat = true;
+            }
+        }
+        currentKey = Key::Other;
+    }
+};
@@ -0,0 +1,491 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Minimal epoll-driven HTTP/1.1 endpoint for setWebhook delivery: accepts
+// POSTed updates on one path, checks the secret token header and hands the
+// raw JSON body to onUpdate together with a ticket. The HTTP response for
+// that update is held until reply() or replyAll() is called with the ticket,
+// so it can carry one Bot API method call back to Telegram. Requests
+// pipelined behind a held one are only parsed by replyAll(), never from
+// inside a handler's reply().
+class WebhookServer {
+public:
+    using UpdateHandler = std::function<void(const std::string& body, uint64_t ticket)>;
+
+    UpdateHandler onUpdate;
+
+    std::string path = "/";
+    std::string secretToken;
+    size_t maxHeaderBytes = 16 * 1024;
+    size_t maxBodyBytes = 1 << 20;
+    size_t maxConnections = 256;
+    size_t delivered = 0;
+    size_t rejected = 0;
+    size_t inlineReplies = 0;
+
+    WebhookServer() = default;
+
+    ~WebhookServer() {
+        close();
+    }
+
+    WebhookServer(const WebhookServer&) = delete;
+    WebhookServer& operator=(const WebhookServer&) = delete;
+
+    bool listen(const std::string& host, int port) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)port);
+        if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            std::cerr << "WebhookServer invalid address: " << host << std::endl;
+            return false;
+        }
+        listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            std::cerr << "WebhookServer socket error: " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        int one = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::bind(listenFd, (sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(listenFd, SOMAXCONN) < 0) {
+            std::cerr << "WebhookServer listen error: " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            std::cerr << "WebhookServer epoll error: " << std::strerror(errno) << std::endl;
+            close();
+            return false;
+        }
+        watch(listenFd, EPOLLIN, EPOLL_CTL_ADD);
+        return true;
+    }
+
+    // Becomes readable whenever poll() has work, so it can be waited on
+    // alongside other descriptors.
+    int fd() const {
+        return epollFd;
+    }
+
+    void poll(int timeoutMs) {
+        if (epollFd < 0) return;
+        epoll_event events[64];
+        int count = epoll_wait(epollFd, events, 64, timeoutMs);
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptAll();
+                continue;
+            }
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            Connection& conn = it->second;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                drop(fd);
+                continue;
+            }
+            if ((events[i].events & EPOLLIN) && !readFrom(conn)) continue;
+            if (events[i].events & EPOLLOUT) flush(conn);
+        }
+    }
+
+    bool pending(uint64_t ticket) const {
+        return tickets.count(ticket) != 0;
+    }
+
+    // Completes the held response for ticket; a non-empty body is sent as
+    // the JSON method call Telegram executes on the bot's behalf.
+    bool reply(uint64_t ticket, const std::string& body) {
+        auto it = tickets.find(ticket);
+        if (it == tickets.end()) return false;
+        int fd = it->second;
+        tickets.erase(it);
+        auto connIt = connections.find(fd);
+        if (connIt == connections.end()) return false;
+        Connection& conn = connIt->second;
+        conn.ticket = 0;
+        if (!body.empty()) ++inlineReplies;
+        writeResponse(conn, 200, body, conn.closeAfterReply || conn.peerClosed);
+        released.push_back(fd);
+        flush(conn);
+        return true;
+    }
+
+    // Completes every held response, then parses the requests pipelined
+    // behind them. Those go to onUpdate as usual, so the caller has a new
+    // batch to dispatch when this delivered anything; returns how many.
+    size_t replyAll() {
+        while (!tickets.empty()) {
+            reply(tickets.begin()->first, "");
+        }
+        size_t before = delivered;
+        std::vector<int> resume;
+        resume.swap(released);
+        for (int fd : resume) {
+            auto it = connections.find(fd);
+            if (it == connections.end()) continue;
+            process(it->second);
+            flush(it->second);
+        }
+        return delivered - before;
+    }
+
+    void close() {
+        for (auto& [fd, conn] : connections) {
+            ::close(fd);
+        }
+        connections.clear();
+        tickets.clear();
+        released.clear();
+        if (listenFd >= 0) ::close(listenFd);
+        if (epollFd >= 0) ::close(epollFd);
+        listenFd = -1;
+        epollFd = -1;
+    }
+
+private:
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        bool closeAfterWrite = false;
+        bool closeAfterReply = false;
+        bool peerClosed = false;
+        bool wantWrite = false;
+        uint64_t ticket = 0;
+    };
+
+    struct Request {
+        std::string method;
+        std::string target;
+        std::string secret;
+        size_t contentLength = 0;
+        bool chunked = false;
+        bool close = false;
+    };
+
+    int listenFd = -1;
+    int epollFd = -1;
+    std::unordered_map<int, Connection> connections;
+    std::unordered_map<uint64_t, int> tickets;
+    // Connections whose held response went out since the last replyAll().
+    std::vector<int> released;
+    uint64_t nextTicket = 1;
+
+    void watch(int fd, uint32_t events, int op) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd, op, fd, &ev);
+    }
+
+    void acceptAll() {
+        while (true) {
+            int fd = ::accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    std::cerr << "WebhookServer accept error: " << std::strerror(errno) << std::endl;
+                }
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (connections.size() >= maxConnections) {
+                ::close(fd);
+                continue;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            Connection& conn = connections[fd];
+            conn.fd = fd;
+            watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+        }
+    }
+
+    void drop(int fd) {
+        auto it = connections.find(fd);
+        if (it != connections.end() && it->second.ticket != 0) {
+            tickets.erase(it->second.ticket);
+        }
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+        ::close(fd);
+        connections.erase(fd);
+    }
+
+    // Returns false once the connection has been dropped.
+    bool readFrom(Connection& conn) {
+        char buffer[16 * 1024];
+        bool peerClosed = false;
+        while (true) {
+            ssize_t n = ::recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (n > 0) {
+                conn.in.append(buffer, (size_t)n);
+                continue;
+            }
+            if (n == 0) {
+                peerClosed = true;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                peerClosed = true;
+            }
+            break;
+        }
+        process(conn);
+        if (peerClosed) {
+            conn.peerClosed = true;
+            if (conn.ticket == 0) {
+                conn.closeAfterWrite = true;
+            } else {
+                watch(conn.fd, 0, EPOLL_CTL_MOD);
+            }
+        }
+        return flush(conn);
+    }
+
+    void process(Connection& conn) {
+        while (!conn.closeAfterWrite && conn.ticket == 0) {
+            size_t headerEnd = conn.in.find("\r\n\r\n");
+            if (headerEnd == std::string::npos) {
+                if (conn.in.size() > maxHeaderBytes) respond(conn, 431, true);
+                return;
+            }
+            Request req;
+            if (!parseHead(conn.in, headerEnd, req)) {
+                respond(conn, 400, true);
+                return;
+            }
+            std::string body;
+            size_t total = 0;
+            if (req.chunked) {
+                Body state = decodeChunked(conn.in, headerEnd + 4, body, total);
+                if (state == Body::Malformed) {
+                    respond(conn, 400, true);
+                    return;
+                }
+                if (state == Body::TooLarge || (state == Body::Incomplete && conn.in.size() > headerEnd + maxHeaderBytes + maxBodyBytes)) {
+                    respond(conn, 413, true);
+                    return;
+                }
+                if (state == Body::Incomplete) return;
+            } else {
+                if (req.contentLength > maxBodyBytes) {
+                    respond(conn, 413, true);
+                    return;
+                }
+                total = headerEnd + 4 + req.contentLength;
+                if (conn.in.size() < total) return;
+                body = conn.in.substr(headerEnd + 4, req.contentLength);
+            }
+            conn.in.erase(0, total);
+
+            int status = 200;
+            if (req.method != "POST") {
+                status = 405;
+            } else if (req.target != path) {
+                status = 404;
+            } else if (!secretToken.empty() && !constantTimeEquals(req.secret, secretToken)) {
+                status = 401;
+            }
+            if (status != 200 || !onUpdate) {
+                ++rejected;
+                respond(conn, status, req.close);
+                continue;
+            }
+            ++delivered;
+            uint64_t ticket = nextTicket++;
+            conn.ticket = ticket;
+            conn.closeAfterReply = req.close;
+            tickets[ticket] = conn.fd;
+            onUpdate(body, ticket);
+        }
+    }
+
+    static bool parseHead(const std::string& in, size_t headerEnd, Request& req) {
+        size_t lineEnd = in.find("\r\n");
+        size_t methodEnd = in.find(' ');
+        if (methodEnd == std::string::npos || methodEnd > lineEnd) return false;
+        size_t targetEnd = in.find(' ', methodEnd + 1);
+        if (targetEnd == std::string::npos || targetEnd > lineEnd) return false;
+        req.method = in.substr(0, methodEnd);
+        req.target = in.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+        std::string version = in.substr(targetEnd + 1, lineEnd - targetEnd - 1);
+        if (version.compare(0, 5, "HTTP/") != 0) return false;
+        bool keepAlive = version != "HTTP/1.0";
+
+        size_t pos = lineEnd + 2;
+        while (pos < headerEnd) {
+            size_t end = in.find("\r\n", pos);
+            if (end == std::string::npos || end > headerEnd) end = headerEnd;
+            size_t colon = in.find(':', pos);
+            if (colon == std::string::npos || colon > end) return false;
+            std::string name = in.substr(pos, colon - pos);
+            std::string value = trimmed(in.substr(colon + 1, end - colon - 1));
+
+            if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+                char* parsedEnd = NULL;
+                errno = 0;
+                unsigned long long length = std::strtoull(value.c_str(), &parsedEnd, 10);
+                if (errno != 0 || parsedEnd == value.c_str() || *parsedEnd != '\0') return false;
+                req.contentLength = (size_t)length;
+            } else if (strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+                // identity changes nothing; chunked is the only coding
+                // decoded here, and it must come last or the body has no
+                // known end.
+                size_t start = 0;
+                while (start <= value.size()) {
+                    size_t comma = std::min(value.find(',', start), value.size());
+                    std::string coding = trimmed(value.substr(start, comma - start));
+                    start = comma + 1;
+                    if (coding.empty()) continue;
+                    if (req.chunked) return false;
+                    if (strcasecmp(coding.c_str(), "chunked") == 0) {
+                        req.chunked = true;
+                    } else if (strcasecmp(coding.c_str(), "identity") != 0) {
+                        return false;
+                    }
+                }
+            } else if (strcasecmp(name.c_str(), "X-Telegram-Bot-Api-Secret-Token") == 0) {
+                req.secret = value;
+            } else if (strcasecmp(name.c_str(), "Connection") == 0) {
+                if (strcasecmp(value.c_str(), "close") == 0) keepAlive = false;
+                if (strcasecmp(value.c_str(), "keep-alive") == 0) keepAlive = true;
+            }
+            pos = end + 2;
+        }
+        req.close = !keepAlive;
+        return true;
+    }
+
+    static std::string trimmed(const std::string& text) {
+        size_t first = text.find_first_not_of(" \t");
+        if (first == std::string::npos) return "";
+        return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    }
+
+    enum class Body {
+        Complete,
+        Incomplete,
+        Malformed,
+        TooLarge
+    };
+
+    // Decodes a chunked body starting at start; on Complete, end is the
+    // offset just past the trailer section.
+    Body decodeChunked(const std::string& in, size_t start, std::string& body, size_t& end) const {
+        size_t pos = start;
+        while (true) {
+            size_t lineEnd = in.find("\r\n", pos);
+            if (lineEnd == std::string::npos) return Body::Incomplete;
+            if (pos == lineEnd || !std::isxdigit((unsigned char)in[pos])) return Body::Malformed;
+            char* digitsEnd = NULL;
+            errno = 0;
+            unsigned long long size = std::strtoull(in.c_str() + pos, &digitsEnd, 16);
+            if (errno != 0 || (digitsEnd != in.c_str() + lineEnd && *digitsEnd != ';' && *digitsEnd != ' ' && *digitsEnd != '\t')) {
+                return Body::Malformed;
+            }
+            pos = lineEnd + 2;
+            if (size == 0) break;
+            if (size > maxBodyBytes - body.size()) return Body::TooLarge;
+            if (in.size() < pos + size + 2) return Body::Incomplete;
+            if (in.compare(pos + size, 2, "\r\n") != 0) return Body::Malformed;
+            body.append(in, pos, (size_t)size);
+            pos += size + 2;
+        }
+        // Trailer fields are read past and ignored.
+        while (true) {
+            size_t lineEnd = in.find("\r\n", pos);
+            if (lineEnd == std::string::npos) return Body::Incomplete;
+            if (lineEnd == pos) {
+                end = pos + 2;
+                return Body::Complete;
+            }
+            pos = lineEnd + 2;
+        }
+    }
+
+    static bool constantTimeEquals(const std::string& a, const std::string& b) {
+        if (a.size() != b.size()) return false;
+        unsigned char diff = 0;
+        for (size_t i = 0; i < a.size(); ++i) {
+            diff |= (unsigned char)(a[i] ^ b[i]);
+        }
+        return diff == 0;
+    }
+
+    static const char* reason(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 401: return "Unauthorized";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 413: return "Payload Too Large";
+            case 431: return "Request Header Fields Too Large";
+            default: return "Error";
+        }
+    }
+
+    void respond(Connection& conn, int status, bool closeAfter) {
+        writeResponse(conn, status, "", closeAfter);
+    }
+
+    void writeResponse(Connection& conn, int status, const std::string& body, bool closeAfter) {
+        conn.out += "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\n";
+        if (!body.empty()) {
+            conn.out += "Content-Type: application/json\r\n";
+        }
+        conn.out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        conn.out += closeAfter ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+        conn.out += body;
+        if (closeAfter) conn.closeAfterWrite = true;
+    }
+
+    // Returns false once the connection has been dropped.
+    bool flush(Connection& conn) {
+        while (!conn.out.empty()) {
+            ssize_t n = ::send(conn.fd, conn.out.data(), conn.out.size(), MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.out.erase(0, (size_t)n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                if (!conn.wantWrite) {
+                    conn.wantWrite = true;
+                    watch(conn.fd, EPOLLIN | EPOLLOUT | EPOLLRDHUP, EPOLL_CTL_MOD);
+                }
+                return true;
+            }
+            drop(conn.fd);
+            return false;
+        }
+        if (conn.closeAfterWrite) {
+            drop(conn.fd);
+            return false;
+        }
+        if (conn.wantWrite) {
+            conn.wantWrite = false;
+            watch(conn.fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_MOD);
+        }
+        return true;
+    }
+};